@@ -0,0 +1,135 @@
+#ifndef BINDLESS_H
+#define BINDLESS_H
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+#include "shader.h"
+#include "texture_cache.h"
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+ * ARB_bindless_texture handles, made resident once per texture and then passed to the shaders
+ * instead of binding the texture to a unit: Material writes them into its MaterialTextureBlock,
+ * Cube and Skybox set them on their layout(bindless_sampler) uniforms.
+ *
+ * A handle freezes the texture's levels and sampling state, so textures a loader is still
+ * changing (see Busy) get no handle and stay on the bound path until the loader is done.
+ * Without the extension Active() is false and every caller binds as before. The shaders opt in
+ * with "#extension GL_ARB_bindless_texture : enable" and #ifdef GL_ARB_bindless_texture, so one
+ * source compiles for both paths. GL thread only.
+ */
+class BindlessTextures
+{
+public:
+  bool Enabled = false;
+  // loaders report textures whose levels or parameters they may still change
+  vector<function<bool(unsigned int id)>> Busy;
+
+  // glBindTexture calls skipped because the texture was reached through its handle
+  unsigned int bindsAvoided = 0;          // this frame, see EndFrame
+  unsigned int lastFrameBindsAvoided = 0;
+  size_t totalBindsAvoided = 0;
+
+  static BindlessTextures &Instance()
+  {
+    static BindlessTextures bindless;
+    return bindless;
+  }
+
+  // valid after LoadGLExtensions
+  bool Supported() const
+  {
+    return glGetTextureHandleARB && glMakeTextureHandleResidentARB && glUniformHandleui64ARB;
+  }
+
+  bool Active() const
+  {
+    return Enabled && Supported();
+  }
+
+  // resident handle of the texture, made on first use; 0 when the texture has to be bound instead
+  GLuint64 Handle(unsigned int textureID)
+  {
+    if (textureID == 0 || !Active())
+      return 0;
+    auto found = handles.find(textureID);
+    if (found != handles.end())
+      return found->second;
+    for (const auto &busy : Busy)
+      if (busy(textureID))
+        return 0;
+
+    GLuint64 handle = glGetTextureHandleARB(textureID);
+    if (handle == 0)
+    {
+      // incomplete textures have no handle; clear the error and keep binding this one
+      glGetError();
+      return 0;
+    }
+    glMakeTextureHandleResidentARB(handle);
+    handles[textureID] = handle;
+    return handle;
+  }
+
+  // points a layout(bindless_sampler) uniform of the program in use at the texture; false when it must be bound instead
+  bool SetSampler(const Shader &shader, UniformName name, unsigned int textureID)
+  {
+    GLuint64 handle = Handle(textureID);
+    if (handle == 0)
+      return false;
+    shader.setHandle(name, handle);
+    return true;
+  }
+
+  // makes the texture's handle non-resident; call before deleting a texture that may have one
+  void Forget(unsigned int textureID)
+  {
+    auto found = handles.find(textureID);
+    if (found == handles.end())
+      return;
+    glMakeTextureHandleNonResidentARB(found->second);
+    handles.erase(found);
+  }
+
+  // call once per frame after the last draw
+  void EndFrame()
+  {
+    lastFrameBindsAvoided = bindsAvoided;
+    totalBindsAvoided += bindsAvoided;
+    bindsAvoided = 0;
+  }
+
+  size_t ResidentHandles() const
+  {
+    return handles.size();
+  }
+
+  void PrintStats() const
+  {
+    if (!Supported())
+    {
+      printf("BINDLESS:: GL_ARB_bindless_texture not supported, binding textures\n");
+      return;
+    }
+    printf("BINDLESS:: %s, %zu resident handles, %u binds avoided last frame (%zu total)\n", Enabled ? "enabled" : "disabled",
+           handles.size(), lastFrameBindsAvoided, totalBindsAvoided);
+  }
+
+private:
+  unordered_map<unsigned int, GLuint64> handles;
+
+  BindlessTextures()
+  {
+    TextureCache::Instance().OnDelete.push_back([this](unsigned int id) { Forget(id); });
+  }
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// axis-aligned bounding box
+struct AABB
+{
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 max = glm::vec3(0.0f);
+
+  glm::vec3 Center() const
+  {
+    return (min + max) * 0.5f;
+  }
+
+  glm::vec3 Extent() const
+  {
+    return (max - min) * 0.5f;
+  }
+};
+
+struct BoundingSphere
+{
+  glm::vec3 center = glm::vec3(0.0f);
+  float radius = 0.0f;
+};
+
+// box and sphere around points; the sphere is centred on the box, which is tight enough for culling
+template <typename Point, typename GetPosition>
+void ComputeBounds(const vector<Point> &points, GetPosition position, AABB &box, BoundingSphere &sphere)
+{
+  box = AABB();
+  sphere = BoundingSphere();
+  if (points.empty())
+    return;
+  box.min = box.max = position(points[0]);
+  for (const Point &point : points)
+  {
+    box.min = glm::min(box.min, position(point));
+    box.max = glm::max(box.max, position(point));
+  }
+  sphere.center = box.Center();
+  float radius2 = 0.0f;
+  for (const Point &point : points)
+  {
+    glm::vec3 offset = position(point) - sphere.center;
+    radius2 = std::max(radius2, glm::dot(offset, offset));
+  }
+  sphere.radius = sqrt(radius2);
+}
+
+// box around a transformed box (Arvo): transform the centre, grow the extent by |M|
+inline AABB TransformBounds(const AABB &box, const glm::mat4 &transform)
+{
+  glm::vec3 center = glm::vec3(transform * glm::vec4(box.Center(), 1.0f));
+  glm::vec3 extent = box.Extent();
+  glm::vec3 worldExtent(0.0f);
+  for (int column = 0; column < 3; column++)
+    worldExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+  AABB result;
+  result.min = center - worldExtent;
+  result.max = center + worldExtent;
+  return result;
+}
+
+// sphere around a transformed sphere, scaled by the largest axis scale
+inline BoundingSphere TransformBounds(const BoundingSphere &sphere, const glm::mat4 &transform)
+{
+  float scale2 = 0.0f;
+  for (int column = 0; column < 3; column++)
+    scale2 = std::max(scale2, glm::dot(glm::vec3(transform[column]), glm::vec3(transform[column])));
+  BoundingSphere result;
+  result.center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+  result.radius = sphere.radius * sqrt(scale2);
+  return result;
+}
+
+#endif
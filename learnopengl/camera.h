@@ -7,6 +7,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "frustum.h"
+#include "lod.h"
+#include "shader.h"
+
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -25,6 +29,16 @@ const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
 
+// std140 layout of the CameraBlock uniform block shared by every program
+struct CameraUniforms
+{
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProjection;
+  glm::vec4 position; // xyz = camera position
+  glm::vec4 time;     // x = seconds since start
+};
+
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
 class Camera
 {
@@ -42,6 +56,8 @@ public:
   float MovementSpeed;
   float MouseSensitivity;
   float Zoom;
+  // per-frame uniform buffer bound at CAMERA_BLOCK_BINDING
+  unsigned int UBO = 0;
 
   // constructor with vectors
   Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
@@ -68,6 +84,43 @@ public:
     return glm::lookAt(Position, Position + Front, Up);
   }
 
+  // world-space view frustum for culling with the given projection
+  Frustum GetFrustum(const glm::mat4 &projection)
+  {
+    return Frustum::FromMatrix(projection * GetViewMatrix());
+  }
+
+  // LOD selection parameters for a perspective projection of Zoom degrees onto viewportHeight pixels
+  LodView GetLodView(float viewportHeight)
+  {
+    LodView view;
+    view.position = Position;
+    view.pixelsPerUnit = viewportHeight / (2.0f * tan(glm::radians(Zoom) * 0.5f));
+    return view;
+  }
+
+  // uploads this frame's camera data once for all programs; call after the camera moved for the frame
+  void UpdateUniformBuffer(const glm::mat4 &projection, float time)
+  {
+    CameraUniforms uniforms;
+    uniforms.view = GetViewMatrix();
+    uniforms.projection = projection;
+    uniforms.viewProjection = projection * uniforms.view;
+    uniforms.position = glm::vec4(Position, 1.0f);
+    uniforms.time = glm::vec4(time, 0.0f, 0.0f, 0.0f);
+
+    if (UBO == 0)
+    {
+      glGenBuffers(1, &UBO);
+      glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+      glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, UBO);
+  }
+
   // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
   void ProcessKeyboard(Camera_Movement direction, float deltaTime)
   {
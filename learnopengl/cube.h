@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <bindless.h>
 #include <shader.h>
 
 class Cube
@@ -25,12 +26,18 @@ public:
 
   void Draw(Shader &shader)
   {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+    // the cubemap's bindless handle when the driver has one, see BindlessTextures
+    BindlessTextures &bindless = BindlessTextures::Instance();
+    if (bindless.SetSampler(shader, "skybox"_u, cubeMap))
+      bindless.bindsAvoided++;
+    else
+    {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+    }
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
-    glActiveTexture(GL_TEXTURE0);
   }
 
 private:
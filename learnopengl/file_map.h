@@ -0,0 +1,101 @@
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// 64-bit FNV-1a, used to key caches on file content
+inline uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Read-only view of a whole file, memory mapped where the platform allows it
+class MappedFile
+{
+public:
+  MappedFile() : data(nullptr), size(0), mapped(false) {}
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { close(); }
+
+  bool open(const string &path)
+  {
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED)
+      {
+        data = static_cast<const char *>(ptr);
+        size = st.st_size;
+        mapped = true;
+      }
+    }
+    ::close(fd);
+    return mapped;
+#else
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file)
+      return false;
+    buffer.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+    data = buffer.data();
+    size = buffer.size();
+    return !buffer.empty();
+#endif
+  }
+
+  void close()
+  {
+#ifndef _WIN32
+    if (mapped)
+      munmap(const_cast<char *>(data), size);
+#endif
+    buffer.clear();
+    data = nullptr;
+    size = 0;
+    mapped = false;
+  }
+
+  const char *data;
+  size_t size;
+
+private:
+  bool mapped;
+  vector<char> buffer;
+};
+
+// content hash of a whole file, 0 if it cannot be read
+inline uint64_t HashFile(const string &path)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return 0;
+  return fnv1a64(file.data, file.size);
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// frame times of a run, summarised as mean and nearest-rank percentiles
+class FrameStats
+{
+public:
+  void Add(double milliseconds)
+  {
+    frameMs.push_back(milliseconds);
+    sortedMs.clear();
+  }
+
+  void Clear()
+  {
+    frameMs.clear();
+    sortedMs.clear();
+  }
+
+  size_t Count() const
+  {
+    return frameMs.size();
+  }
+
+  double Mean() const
+  {
+    if (frameMs.empty())
+      return 0.0;
+    double total = 0.0;
+    for (double ms : frameMs)
+      total += ms;
+    return total / frameMs.size();
+  }
+
+  // percentile in [0, 100]
+  double Percentile(double percentile) const
+  {
+    if (frameMs.empty())
+      return 0.0;
+    if (sortedMs.empty())
+    {
+      sortedMs = frameMs;
+      sort(sortedMs.begin(), sortedMs.end());
+    }
+    size_t rank = size_t(ceil(percentile / 100.0 * sortedMs.size()));
+    return sortedMs[min(max(rank, size_t(1)), sortedMs.size()) - 1];
+  }
+
+  double Max() const
+  {
+    return Percentile(100.0);
+  }
+
+  // one "LABEL:: ..." line on stdout
+  void Print(const char *label) const
+  {
+    double mean = Mean();
+    printf("%s:: %zu frames, mean %.3f ms (%.1f fps), p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n", label, Count(), mean,
+           mean > 0.0 ? 1000.0 / mean : 0.0, Percentile(50.0), Percentile(95.0), Percentile(99.0), Max());
+  }
+
+  // the same summary plus every frame time, as a JSON object
+  bool WriteJSON(const string &path, const char *label) const
+  {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+      cout << "ERROR::FRAME_STATS::WRITE_FAILED " << path << endl;
+      return false;
+    }
+    fprintf(file, "{\n  \"name\": \"%s\",\n  \"frames\": %zu,\n  \"mean_ms\": %.4f,\n  \"p50_ms\": %.4f,\n  \"p95_ms\": %.4f,\n"
+                  "  \"p99_ms\": %.4f,\n  \"max_ms\": %.4f,\n  \"frame_ms\": [",
+            label, Count(), Mean(), Percentile(50.0), Percentile(95.0), Percentile(99.0), Max());
+    // in recorded order, so warm-up frames stay visible
+    for (size_t i = 0; i < frameMs.size(); i++)
+      fprintf(file, "%s%.4f", i == 0 ? "" : ", ", frameMs[i]);
+    fprintf(file, "]\n}\n");
+    fclose(file);
+    return true;
+  }
+
+private:
+  vector<double> frameMs;          // in recorded order
+  mutable vector<double> sortedMs; // built by the first Percentile after a change
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define FRUSTUM_X86 1
+#include <immintrin.h>
+#endif
+
+// lets the AVX path live in a binary built without -mavx; it only runs when the CPU has AVX
+#if defined(FRUSTUM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FRUSTUM_TARGET_AVX __attribute__((target("avx")))
+#define FRUSTUM_HAS_AVX_PATH 1
+#elif defined(FRUSTUM_X86) && defined(__AVX__)
+#define FRUSTUM_TARGET_AVX
+#define FRUSTUM_HAS_AVX_PATH 1
+#endif
+
+using namespace std;
+
+enum FrustumPlane
+{
+  FRUSTUM_LEFT,
+  FRUSTUM_RIGHT,
+  FRUSTUM_BOTTOM,
+  FRUSTUM_TOP,
+  FRUSTUM_NEAR,
+  FRUSTUM_FAR,
+  FRUSTUM_PLANE_COUNT
+};
+
+/*
+ * Six inward-facing planes (xyz = unit normal, w = distance), so a point p is inside when
+ * dot(plane.xyz, p) + plane.w >= 0 for every plane.
+ */
+struct Frustum
+{
+  glm::vec4 planes[FRUSTUM_PLANE_COUNT];
+
+  // Gribb/Hartmann extraction from a projection * view matrix; planes are in world space
+  static Frustum FromMatrix(const glm::mat4 &viewProjection)
+  {
+    glm::mat4 m = glm::transpose(viewProjection); // rows of viewProjection
+    Frustum frustum;
+    frustum.planes[FRUSTUM_LEFT] = m[3] + m[0];
+    frustum.planes[FRUSTUM_RIGHT] = m[3] - m[0];
+    frustum.planes[FRUSTUM_BOTTOM] = m[3] + m[1];
+    frustum.planes[FRUSTUM_TOP] = m[3] - m[1];
+    frustum.planes[FRUSTUM_NEAR] = m[3] + m[2];
+    frustum.planes[FRUSTUM_FAR] = m[3] - m[2];
+    for (glm::vec4 &plane : frustum.planes)
+      plane /= glm::length(glm::vec3(plane));
+    return frustum;
+  }
+
+  bool Intersects(const AABB &box) const
+  {
+    glm::vec3 center = box.Center(), extent = box.Extent();
+    for (const glm::vec4 &plane : planes)
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -glm::dot(glm::abs(glm::vec3(plane)), extent))
+        return false;
+    return true;
+  }
+
+  bool Intersects(const BoundingSphere &sphere) const
+  {
+    for (const glm::vec4 &plane : planes)
+      if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+        return false;
+    return true;
+  }
+};
+
+enum CullPath
+{
+  CULL_SCALAR,
+  CULL_SSE,  // 4 boxes per step
+  CULL_AVX,  // 8 boxes per step
+  CULL_BEST  // AVX when the CPU has it, then SSE, then scalar
+};
+
+/*
+ * Frustum test for many boxes at once. Boxes are stored as structure-of-arrays (centre and
+ * half extent per axis) padded to a multiple of 8, so the SIMD paths load 4 or 8 boxes per
+ * instruction and test them against each plane without shuffles. Cull writes one byte per
+ * box to visible and keeps the counts of the last call.
+ */
+class FrustumCuller
+{
+public:
+  vector<float> centerX, centerY, centerZ;
+  vector<float> extentX, extentY, extentZ;
+  vector<uint8_t> visible;
+
+  // results of the last Cull
+  unsigned int visibleCount = 0;
+  unsigned int culledCount = 0;
+
+  void Resize(size_t count)
+  {
+    this->count = count;
+    size_t padded = (count + 7) & ~size_t(7);
+    for (vector<float> *column : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+      column->assign(padded, 0.0f);
+    visible.assign(padded, 0);
+  }
+
+  size_t Size() const
+  {
+    return count;
+  }
+
+  void Set(size_t i, const AABB &box)
+  {
+    glm::vec3 center = box.Center(), extent = box.Extent();
+    centerX[i] = center.x;
+    centerY[i] = center.y;
+    centerZ[i] = center.z;
+    extentX[i] = extent.x;
+    extentY[i] = extent.y;
+    extentZ[i] = extent.z;
+  }
+
+  static bool PathAvailable(CullPath path)
+  {
+    if (path == CULL_SCALAR || path == CULL_BEST)
+      return true;
+#ifdef FRUSTUM_X86
+    if (path == CULL_SSE)
+      return true;
+#endif
+#ifdef FRUSTUM_HAS_AVX_PATH
+    if (path == CULL_AVX)
+      return cpuHasAVX();
+#endif
+    return false;
+  }
+
+  // returns the number of visible boxes
+  unsigned int Cull(const Frustum &frustum, CullPath path = CULL_BEST)
+  {
+    if (path == CULL_BEST)
+      path = PathAvailable(CULL_AVX) ? CULL_AVX : PathAvailable(CULL_SSE) ? CULL_SSE : CULL_SCALAR;
+    if (!PathAvailable(path))
+      path = CULL_SCALAR;
+
+    if (path == CULL_SCALAR)
+      cullScalar(frustum);
+#ifdef FRUSTUM_X86
+    else if (path == CULL_SSE)
+      cullSSE(frustum);
+#endif
+#ifdef FRUSTUM_HAS_AVX_PATH
+    else if (path == CULL_AVX)
+      cullAVX(frustum);
+#endif
+
+    visibleCount = 0;
+    for (size_t i = 0; i < count; i++)
+      visibleCount += visible[i];
+    culledCount = static_cast<unsigned int>(count) - visibleCount;
+    return visibleCount;
+  }
+
+private:
+  size_t count = 0;
+
+  static bool cpuHasAVX()
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx");
+#else
+    return true; // only compiled in with __AVX__
+#endif
+  }
+
+  void cullScalar(const Frustum &frustum)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      bool inside = true;
+      for (const glm::vec4 &plane : frustum.planes)
+      {
+        float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+        float radius = fabs(plane.x) * extentX[i] + fabs(plane.y) * extentY[i] + fabs(plane.z) * extentZ[i];
+        if (distance + radius < 0.0f)
+        {
+          inside = false;
+          break;
+        }
+      }
+      visible[i] = inside;
+    }
+  }
+
+#ifdef FRUSTUM_X86
+  void cullSSE(const Frustum &frustum)
+  {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (size_t i = 0; i < count; i += 4)
+    {
+      __m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+      __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+      __m128 outside = _mm_setzero_ps();
+      for (const glm::vec4 &plane : frustum.planes)
+      {
+        __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex), _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                   _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+      }
+      int mask = _mm_movemask_ps(outside);
+      for (int lane = 0; lane < 4; lane++)
+        visible[i + lane] = !((mask >> lane) & 1);
+    }
+  }
+#endif
+
+#ifdef FRUSTUM_HAS_AVX_PATH
+  FRUSTUM_TARGET_AVX void cullAVX(const Frustum &frustum)
+  {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (size_t i = 0; i < count; i += 8)
+    {
+      __m256 cx = _mm256_loadu_ps(&centerX[i]), cy = _mm256_loadu_ps(&centerY[i]), cz = _mm256_loadu_ps(&centerZ[i]);
+      __m256 ex = _mm256_loadu_ps(&extentX[i]), ey = _mm256_loadu_ps(&extentY[i]), ez = _mm256_loadu_ps(&extentZ[i]);
+      __m256 outside = _mm256_setzero_ps();
+      for (const glm::vec4 &plane : frustum.planes)
+      {
+        __m256 nx = _mm256_set1_ps(plane.x), ny = _mm256_set1_ps(plane.y), nz = _mm256_set1_ps(plane.z);
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                        _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(plane.w)));
+        __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex), _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)),
+                                      _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+      }
+      int mask = _mm256_movemask_ps(outside);
+      for (int lane = 0; lane < 8; lane++)
+        visible[i + lane] = !((mask >> lane) & 1);
+    }
+  }
+#endif
+};
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "vertex.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+// first-fit free list over [0, capacity), in elements; neighbouring free blocks are merged
+class RangeAllocator
+{
+public:
+  size_t capacity = 0;
+  size_t used = 0;
+  map<size_t, size_t> freeBlocks; // offset -> size
+
+  bool Allocate(size_t count, size_t &offset)
+  {
+    for (auto block = freeBlocks.begin(); block != freeBlocks.end(); ++block)
+    {
+      if (block->second < count)
+        continue;
+      offset = block->first;
+      size_t remaining = block->second - count;
+      freeBlocks.erase(block);
+      if (remaining > 0)
+        freeBlocks[offset + count] = remaining;
+      used += count;
+      return true;
+    }
+    return false;
+  }
+
+  void Free(size_t offset, size_t count)
+  {
+    if (count == 0)
+      return;
+    used -= count;
+    auto next = freeBlocks.lower_bound(offset);
+    if (next != freeBlocks.end() && offset + count == next->first)
+    {
+      count += next->second;
+      next = freeBlocks.erase(next);
+    }
+    if (next != freeBlocks.begin())
+    {
+      auto previous = std::prev(next);
+      if (previous->first + previous->second == offset)
+      {
+        previous->second += count;
+        return;
+      }
+    }
+    freeBlocks[offset] = count;
+  }
+
+  // extends the range to newCapacity; the new tail becomes free space
+  void Grow(size_t newCapacity)
+  {
+    size_t added = newCapacity - capacity;
+    size_t offset = capacity;
+    capacity = newCapacity;
+    used += added; // Free() below subtracts it again
+    Free(offset, added);
+  }
+
+  size_t LargestFreeBlock() const
+  {
+    size_t largest = 0;
+    for (const auto &block : freeBlocks)
+      largest = max(largest, block.second);
+    return largest;
+  }
+
+  // share of free space that is not part of the largest free block
+  float Fragmentation() const
+  {
+    size_t free = capacity - used;
+    return free == 0 ? 0.0f : 1.0f - float(LargestFreeBlock()) / float(free);
+  }
+};
+
+// meshes with at most this many vertices are stored with GL_UNSIGNED_SHORT indices
+const size_t MAX_SHORT_INDEX_VERTICES = 65536;
+
+// where a mesh lives inside an arena; drawn with glDrawElementsBaseVertex
+struct GeometryRange
+{
+  size_t baseVertex = 0;
+  size_t vertexCount = 0;
+  size_t firstIndex = 0; // in units of indexType
+  size_t indexCount = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+
+  size_t IndexSize() const
+  {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+  }
+
+  // byte offset of the first index in the element buffer
+  size_t IndexOffset() const
+  {
+    return firstIndex * IndexSize();
+  }
+
+  // 32-bit words of the element buffer the indices occupy
+  size_t IndexWords() const
+  {
+    return (indexCount * IndexSize() + 3) / 4;
+  }
+};
+
+/*
+ * One vertex buffer, one index buffer and one VAO shared by many meshes of the same vertex
+ * format. Meshes are sub-allocated and keep their indices relative to their own first vertex;
+ * the buffers grow (copying old contents on the GPU) when they run out of space.
+ *
+ * Index space is counted in 32-bit words so 16-bit and 32-bit ranges can share the element
+ * buffer and every range starts aligned for either type.
+ */
+class GeometryArena
+{
+public:
+  VertexFormat format;
+  unsigned int VAO = 0, VBO = 0, EBO = 0;
+  RangeAllocator vertexSpace, indexSpace; // indexSpace is in 32-bit words
+
+  GeometryArena(VertexFormat format = VERTEX_FULL) : format(format) {}
+
+  // indices are stored as GL_UNSIGNED_SHORT when shortIndices is set and vertexCount allows it
+  GeometryRange Allocate(const void *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+                         bool shortIndices = false)
+  {
+    GeometryRange range;
+    range.vertexCount = vertexCount;
+    range.indexCount = indexCount;
+    range.indexType = shortIndices && vertexCount <= MAX_SHORT_INDEX_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if (!vertexSpace.Allocate(vertexCount, range.baseVertex))
+    {
+      reserve(vertexCount, 0);
+      vertexSpace.Allocate(vertexCount, range.baseVertex);
+    }
+    size_t stride = VertexStride(format);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, range.baseVertex * stride, vertexCount * stride, vertexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    uploadIndices(range, indexData);
+    return range;
+  }
+
+  // another index buffer (e.g. a LOD) over the vertices of an existing range; Free it like any range
+  GeometryRange AllocateIndices(const GeometryRange &vertices, const unsigned int *indexData, size_t indexCount)
+  {
+    GeometryRange range;
+    range.baseVertex = vertices.baseVertex;
+    range.indexCount = indexCount;
+    range.indexType = vertices.indexType;
+    uploadIndices(range, indexData);
+    return range;
+  }
+
+  void Free(const GeometryRange &range)
+  {
+    vertexSpace.Free(range.baseVertex, range.vertexCount);
+    indexSpace.Free(range.IndexOffset() / 4, range.IndexWords());
+  }
+
+  // deletes the GL objects; the arena can be reused afterwards
+  void Release()
+  {
+    if (VAO == 0)
+      return;
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+    vertexSpace = RangeAllocator();
+    indexSpace = RangeAllocator();
+  }
+
+  void PrintStats(const char *name) const
+  {
+    size_t stride = VertexStride(format);
+    printf("GEOMETRY_ARENA:: %s vertices %.2f / %.2f MB (%zu free blocks, %.0f%% fragmented), indices %.2f / %.2f MB (%zu free blocks, %.0f%% fragmented)\n",
+           name, vertexSpace.used * stride / 1048576.0, vertexSpace.capacity * stride / 1048576.0, vertexSpace.freeBlocks.size(),
+           vertexSpace.Fragmentation() * 100.0f, indexSpace.used * 4 / 1048576.0, indexSpace.capacity * 4 / 1048576.0,
+           indexSpace.freeBlocks.size(), indexSpace.Fragmentation() * 100.0f);
+  }
+
+private:
+  // allocates index words for range.indexCount indices of range.indexType and uploads them
+  void uploadIndices(GeometryRange &range, const unsigned int *indexData)
+  {
+    size_t words = range.IndexWords(), firstWord;
+    if (!indexSpace.Allocate(words, firstWord))
+    {
+      reserve(0, words);
+      indexSpace.Allocate(words, firstWord);
+    }
+    range.firstIndex = firstWord * 4 / range.IndexSize();
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    if (range.indexType == GL_UNSIGNED_SHORT)
+    {
+      vector<uint16_t> shortData(indexData, indexData + range.indexCount);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, range.IndexOffset(), range.indexCount * sizeof(uint16_t), shortData.data());
+    }
+    else
+      glBufferSubData(GL_COPY_WRITE_BUFFER, range.IndexOffset(), range.indexCount * sizeof(uint32_t), indexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  // grows the buffers so the requested vertices and index words fit in one block, at least doubling them
+  void reserve(size_t vertexCount, size_t indexCount)
+  {
+    if (VAO == 0)
+      glGenVertexArrays(1, &VAO);
+
+    if (vertexCount > 0)
+    {
+      size_t capacity = max(vertexSpace.capacity * 2, vertexSpace.capacity + vertexCount);
+      capacity = max<size_t>(capacity, 65536);
+      VBO = growBuffer(VBO, vertexSpace.capacity * VertexStride(format), capacity * VertexStride(format));
+      vertexSpace.Grow(capacity);
+    }
+    if (indexCount > 0)
+    {
+      size_t capacity = max(indexSpace.capacity * 2, indexSpace.capacity + indexCount);
+      capacity = max<size_t>(capacity, 3 * 65536);
+      EBO = growBuffer(EBO, indexSpace.capacity * sizeof(unsigned int), capacity * sizeof(unsigned int));
+      indexSpace.Grow(capacity);
+    }
+
+    // re-point the shared vertex array at the (possibly new) buffers
+    glBindVertexArray(VAO);
+    if (VBO != 0)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, VBO);
+      SetupVertexAttributes(format);
+    }
+    if (EBO != 0)
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindVertexArray(0);
+  }
+
+  static unsigned int growBuffer(unsigned int buffer, size_t oldSize, size_t newSize)
+  {
+    unsigned int grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+    if (buffer != 0)
+    {
+      glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return grown;
+  }
+};
+
+// one arena per vertex format
+class GeometryArenas
+{
+public:
+  GeometryArena arenas[VERTEX_FORMAT_COUNT] = {GeometryArena(VERTEX_FULL), GeometryArena(VERTEX_PACKED)};
+
+  GeometryArena &For(VertexFormat format)
+  {
+    return arenas[format];
+  }
+
+  void Release()
+  {
+    for (GeometryArena &arena : arenas)
+      arena.Release();
+  }
+
+  void PrintStats() const
+  {
+    arenas[VERTEX_FULL].PrintStats("full");
+    arenas[VERTEX_PACKED].PrintStats("packed");
+  }
+
+  // arenas shared by every Model that does not own its geometry
+  static GeometryArenas &Scene()
+  {
+    static GeometryArenas scene;
+    return scene;
+  }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+/*
+ * Entry points newer than the GL 3.3 core profile glad was generated for. They are loaded by
+ * LoadGLExtensions right after gladLoadGLLoader and stay null on older contexts, so every
+ * caller checks HasGLVersion (or the pointer) and keeps a GL 3.3 path.
+ */
+
+// GL 4.0 - 4.3
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+// EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+typedef void(APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void(APIENTRYP PFNGLDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect);
+typedef void(APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void(APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void(APIENTRYP PFNGLCOPYIMAGESUBDATAPROC)(GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ,
+                                                  GLuint dstName, GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ,
+                                                  GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth);
+
+// ARB_bindless_texture, null when the driver does not expose it (Mesa's llvmpipe among others)
+typedef GLuint64(APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void(APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void(APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+typedef void(APIENTRYP PFNGLUNIFORMHANDLEUI64ARBPROC)(GLint location, GLuint64 value);
+
+inline PFNGLMULTIDRAWELEMENTSINDIRECTPROC glext_glMultiDrawElementsIndirect = nullptr;
+inline PFNGLDRAWELEMENTSINDIRECTPROC glext_glDrawElementsIndirect = nullptr;
+inline PFNGLDISPATCHCOMPUTEPROC glext_glDispatchCompute = nullptr;
+inline PFNGLMEMORYBARRIERPROC glext_glMemoryBarrier = nullptr;
+inline PFNGLCOPYIMAGESUBDATAPROC glext_glCopyImageSubData = nullptr;
+inline PFNGLGETTEXTUREHANDLEARBPROC glext_glGetTextureHandleARB = nullptr;
+inline PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glext_glMakeTextureHandleResidentARB = nullptr;
+inline PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glext_glMakeTextureHandleNonResidentARB = nullptr;
+inline PFNGLUNIFORMHANDLEUI64ARBPROC glext_glUniformHandleui64ARB = nullptr;
+#define glMultiDrawElementsIndirect glext_glMultiDrawElementsIndirect
+#define glDrawElementsIndirect glext_glDrawElementsIndirect
+#define glDispatchCompute glext_glDispatchCompute
+#define glMemoryBarrier glext_glMemoryBarrier
+#define glCopyImageSubData glext_glCopyImageSubData
+#define glGetTextureHandleARB glext_glGetTextureHandleARB
+#define glMakeTextureHandleResidentARB glext_glMakeTextureHandleResidentARB
+#define glMakeTextureHandleNonResidentARB glext_glMakeTextureHandleNonResidentARB
+#define glUniformHandleui64ARB glext_glUniformHandleui64ARB
+
+// context version, valid after LoadGLExtensions
+inline int GLContextMajor = 3;
+inline int GLContextMinor = 3;
+
+inline bool HasGLVersion(int major, int minor)
+{
+  return GLContextMajor > major || (GLContextMajor == major && GLContextMinor >= minor);
+}
+
+// whether the current context lists the extension, e.g. "GL_EXT_texture_compression_s3tc"
+inline bool HasGLExtension(const char *name)
+{
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++)
+  {
+    const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, GLuint(i));
+    if (extension && strcmp(extension, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline void LoadGLExtensions(GLADloadproc load)
+{
+  glGetIntegerv(GL_MAJOR_VERSION, &GLContextMajor);
+  glGetIntegerv(GL_MINOR_VERSION, &GLContextMinor);
+
+  if (HasGLVersion(4, 3))
+  {
+    glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+    glDrawElementsIndirect = (PFNGLDRAWELEMENTSINDIRECTPROC)load("glDrawElementsIndirect");
+    glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+    glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+    glCopyImageSubData = (PFNGLCOPYIMAGESUBDATAPROC)load("glCopyImageSubData");
+  }
+  if (HasGLExtension("GL_ARB_bindless_texture"))
+  {
+    glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)load("glGetTextureHandleARB");
+    glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)load("glMakeTextureHandleResidentARB");
+    glMakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)load("glMakeTextureHandleNonResidentARB");
+    glUniformHandleui64ARB = (PFNGLUNIFORMHANDLEUI64ARBPROC)load("glUniformHandleui64ARB");
+  }
+}
+
+#endif
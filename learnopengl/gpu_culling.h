@@ -0,0 +1,287 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "gl_extensions.h"
+#include "indirect_draw.h"
+#include "instanced_model.h"
+#include "lod.h"
+#include "model.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// LODs the cull shader picks from, the size of lodErrors in instance_cull.comp
+const unsigned int GPU_CULL_MAX_LODS = 8;
+// local_size_x of instance_cull.comp
+const unsigned int GPU_CULL_GROUP_SIZE = 64;
+
+/*
+ * Culls and picks LODs for the instances of an InstancedModel on the GPU (GL 4.3). A compute
+ * pass tests every instance's box against the frustum, picks its LOD from the projected
+ * size of its sphere (with the same hysteresis as LodView::Select) and appends the transform to
+ * that LOD's region of a visible-instance buffer. A second pass copies the per-LOD counts into
+ * one indirect command per mesh and LOD, so each mesh is drawn with glDrawElementsIndirect
+ * straight from GPU results: the CPU never reads anything back.
+ *
+ * Instances are the culling unit: the box, sphere and LOD errors are those of the whole
+ * model (the meshes' bounds under their node transforms), and every mesh of an instance is
+ * drawn at the same LOD, clamped to the LODs the mesh has.
+ *
+ * Without GL 4.3, or with Enabled off, Draw falls back to InstancedModel::Draw, which draws
+ * every instance at LOD 0. The vertex shader is the same on both paths.
+ */
+class GpuInstanceCuller
+{
+public:
+  bool Enabled = true;
+  // read the per-LOD visible counts back after every Draw; this waits for the GPU, so stats only
+  bool ReadBackCounts = false;
+
+  // stats of the last Draw
+  unsigned int callCount = 0;
+  vector<unsigned int> lodInstances; // visible instances per LOD, with ReadBackCounts
+
+  GpuInstanceCuller(const char *computePath)
+  {
+    if (Supported())
+      program.reset(new Shader(computePath));
+  }
+
+  ~GpuInstanceCuller()
+  {
+    Release();
+  }
+
+  static bool Supported()
+  {
+    return HasGLVersion(4, 3) && glDispatchCompute && glMemoryBarrier && glDrawElementsIndirect;
+  }
+
+  bool Active() const
+  {
+    return Enabled && program != nullptr;
+  }
+
+  void Draw(InstancedModel &instances, Shader &shader, const Frustum &frustum, const LodView &lodView)
+  {
+    if (!Active())
+    {
+      instances.Draw(shader);
+      callCount = instances.callCount;
+      return;
+    }
+
+    callCount = 0;
+    unsigned int instanceBuffer = instances.Upload();
+    GLuint count = GLuint(instances.Size());
+    if (count == 0)
+      return;
+    Model &model = *instances.model;
+    model.nodes.Update();
+    reserve(instances.Size());
+    buildCommands(model);
+
+    // cull pass
+    program->use();
+    glUniform4fv(program->location("planes"_u), FRUSTUM_PLANE_COUNT, &frustum.planes[0][0]);
+    glUniform1fv(program->location("lodErrors"_u), GPU_CULL_MAX_LODS, lodErrors);
+    program->setVec3("boundsCenter"_u, bounds.Center());
+    program->setVec3("boundsExtent"_u, bounds.Extent());
+    program->setVec4("sphere"_u, glm::vec4(sphere.center, sphere.radius));
+    program->setVec3("viewPosition"_u, lodView.position);
+    program->setFloat("pixelsPerUnit"_u, lodView.pixelsPerUnit);
+    program->setFloat("pixelError"_u, lodView.pixelError);
+    program->setFloat("hysteresis"_u, lodView.hysteresis);
+    glUniform1ui(program->location("lodCount"_u), lodCount);
+    glUniform1ui(program->location("instanceCount"_u), count);
+    glUniform1ui(program->location("regionSize"_u), GLuint(capacity));
+    glUniform1ui(program->location("commandCount"_u), GLuint(commands.size()));
+    program->setBool("finalize"_u, false);
+
+    const GLuint zeros[GPU_CULL_MAX_LODS] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_INSTANCE_BINDING, visibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COUNT_BINDING, countBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_LOD_BINDING, lodBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BINDING, commandBuffer);
+    glDispatchCompute((count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // finalize pass
+    program->setBool("finalize"_u, true);
+    glDispatchCompute((GLuint(commands.size()) + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    // draw every mesh at every LOD; commands nobody survived for have instanceCount 0
+    shader.use();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    unsigned int boundVAO = 0;
+    int boundNode = -1;
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+      Mesh &mesh = model.meshes[i];
+      if (int(mesh.node) != boundNode)
+      {
+        boundNode = mesh.node;
+        shader.setMat4("model"_u, model.nodes.world[mesh.node]);
+      }
+      mesh.material.Bind(shader);
+      if (mesh.VAO != boundVAO)
+      {
+        if (boundVAO != 0)
+          InstancedModel::DisableInstanceAttributes();
+        boundVAO = mesh.VAO;
+        glBindVertexArray(boundVAO);
+        InstancedModel::EnableInstanceAttributes(visibleBuffer);
+      }
+      for (unsigned int lod = 0; lod < lodCount; lod++)
+      {
+        size_t command = i * lodCount + lod;
+        glDrawElementsIndirect(GL_TRIANGLES, mesh.LodRange(min(lod, mesh.LodCount() - 1)).indexType,
+                               (void *)(command * sizeof(DrawElementsIndirectCommand)));
+        callCount++;
+      }
+    }
+    if (boundVAO != 0)
+      InstancedModel::DisableInstanceAttributes();
+
+    if (ReadBackCounts)
+    {
+      lodInstances.assign(lodCount, 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+      glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lodCount * sizeof(GLuint), lodInstances.data());
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // reset
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // deletes the GPU buffers; the next Draw creates them again
+  void Release()
+  {
+    unsigned int buffers[] = {visibleBuffer, countBuffer, lodBuffer, commandBuffer};
+    for (unsigned int buffer : buffers)
+      if (buffer != 0)
+        glDeleteBuffers(1, &buffer);
+    visibleBuffer = countBuffer = lodBuffer = commandBuffer = 0;
+    capacity = 0;
+    commands.clear();
+  }
+
+private:
+  unique_ptr<Shader> program;
+  unsigned int visibleBuffer = 0; // GPU_CULL_MAX_LODS regions of capacity transforms
+  unsigned int countBuffer = 0;   // visible instances per LOD
+  unsigned int lodBuffer = 0;     // per-instance LOD of the last frame
+  unsigned int commandBuffer = 0; // per mesh and LOD
+  size_t capacity = 0;            // instances the buffers can hold
+
+  // model data shared by every instance, rebuilt each Draw since node transforms may change
+  AABB bounds;
+  BoundingSphere sphere;
+  unsigned int lodCount = 1;
+  float lodErrors[GPU_CULL_MAX_LODS] = {};
+  vector<DrawElementsIndirectCommand> commands;
+
+  void reserve(size_t instanceCount)
+  {
+    if (instanceCount <= capacity)
+      return;
+    // regrowing discards the per-instance LODs, which only costs one frame of hysteresis
+    capacity = max(instanceCount, capacity * 2);
+    if (visibleBuffer == 0)
+    {
+      glGenBuffers(1, &visibleBuffer);
+      glGenBuffers(1, &countBuffer);
+      glGenBuffers(1, &lodBuffer);
+      glGenBuffers(1, &commandBuffer);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, GPU_CULL_MAX_LODS * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, GPU_CULL_MAX_LODS * capacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    vector<GLuint> zeros(capacity, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lodBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), zeros.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    commands.clear(); // baseInstance depends on capacity
+  }
+
+  /*
+   * Model-level box, sphere and LOD errors: LOD l's error is the largest error of any mesh at
+   * that LOD, converted from the mesh's sphere to the model's. Commands are only re-uploaded
+   * when their ranges change, which is never for a loaded model.
+   */
+  void buildCommands(const Model &model)
+  {
+    bounds = AABB();
+    lodCount = 1;
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+      AABB box = TransformBounds(model.meshes[i].bounds, model.nodes.world[model.meshes[i].node]);
+      bounds.min = i == 0 ? box.min : glm::min(bounds.min, box.min);
+      bounds.max = i == 0 ? box.max : glm::max(bounds.max, box.max);
+      lodCount = max(lodCount, min(model.meshes[i].LodCount(), GPU_CULL_MAX_LODS));
+    }
+    // centred on the box and around every mesh's sphere, so one mesh keeps its own sphere
+    sphere.center = bounds.Center();
+    sphere.radius = 0.0f;
+    for (const Mesh &mesh : model.meshes)
+    {
+      BoundingSphere meshSphere = TransformBounds(mesh.sphere, model.nodes.world[mesh.node]);
+      sphere.radius = max(sphere.radius, glm::length(meshSphere.center - sphere.center) + meshSphere.radius);
+    }
+
+    fill(begin(lodErrors), end(lodErrors), 0.0f);
+    for (const Mesh &mesh : model.meshes)
+    {
+      float meshRadius = TransformBounds(mesh.sphere, model.nodes.world[mesh.node]).radius;
+      for (unsigned int lod = 1; lod < lodCount && sphere.radius > 0.0f; lod++)
+      {
+        float error = mesh.lodErrors[min(lod, mesh.LodCount() - 1)] * meshRadius / sphere.radius;
+        lodErrors[lod] = max(lodErrors[lod], error);
+      }
+    }
+
+    vector<DrawElementsIndirectCommand> built;
+    built.reserve(model.meshes.size() * lodCount);
+    for (const Mesh &mesh : model.meshes)
+      for (unsigned int lod = 0; lod < lodCount; lod++)
+      {
+        const GeometryRange &range = mesh.LodRange(min(lod, mesh.LodCount() - 1));
+        DrawElementsIndirectCommand command;
+        command.count = GLuint(range.indexCount);
+        command.instanceCount = 0;
+        command.firstIndex = GLuint(range.firstIndex);
+        command.baseVertex = GLint(range.baseVertex);
+        command.baseInstance = GLuint(lod * capacity);
+        built.push_back(command);
+      }
+    if (built.size() == commands.size() &&
+        equal(built.begin(), built.end(), commands.begin(), [](const DrawElementsIndirectCommand &a, const DrawElementsIndirectCommand &b) {
+          return a.count == b.count && a.firstIndex == b.firstIndex && a.baseVertex == b.baseVertex && a.baseInstance == b.baseInstance;
+        }))
+      return;
+    commands.swap(built);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+};
+
+#endif
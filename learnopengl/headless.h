@@ -0,0 +1,243 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include "frame_stats.h"
+#include "image_writer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if __has_include(<EGL/egl.h>)
+#define HEADLESS_EGL 1
+#include <EGL/egl.h>
+#endif
+
+using namespace std;
+
+/*
+ * Command line of a headless run:
+ *   --headless N        render N frames offscreen instead of opening a window
+ *   --png F1,F2,...     write these frames (0-based) to <png-prefix><frame>.png
+ *   --png-prefix PATH   default "frame_"
+ *   --json PATH         write the frame-time summary and every frame time as JSON
+ *   --size WxH          offscreen framebuffer size, default the window size
+ */
+struct HeadlessOptions
+{
+  unsigned int frames = 0; // 0 = windowed
+  vector<unsigned int> pngFrames;
+  string pngPrefix = "frame_";
+  string jsonPath;
+  unsigned int width = 0, height = 0;
+
+  bool Enabled() const
+  {
+    return frames > 0;
+  }
+
+  bool WritesPNG(unsigned int frame) const
+  {
+    for (unsigned int f : pngFrames)
+      if (f == frame)
+        return true;
+    return false;
+  }
+
+  static HeadlessOptions Parse(int argc, char **argv)
+  {
+    HeadlessOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      if (!isOption(arg))
+      {
+        cout << "WARNING::HEADLESS::UNKNOWN_OPTION " << arg << endl;
+        continue;
+      }
+      // every option takes a value
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (!value)
+      {
+        cout << "WARNING::HEADLESS::MISSING_VALUE " << arg << endl;
+        break;
+      }
+      if (strcmp(arg, "--headless") == 0)
+        options.frames = unsigned(strtoul(value, nullptr, 10));
+      else if (strcmp(arg, "--png") == 0)
+      {
+        for (const char *p = value; *p;)
+        {
+          char *end = nullptr;
+          options.pngFrames.push_back(unsigned(strtoul(p, &end, 10)));
+          p = *end == ',' ? end + 1 : end + strlen(end);
+        }
+      }
+      else if (strcmp(arg, "--png-prefix") == 0)
+        options.pngPrefix = value;
+      else if (strcmp(arg, "--json") == 0)
+        options.jsonPath = value;
+      else if (strcmp(arg, "--size") == 0)
+        sscanf(value, "%ux%u", &options.width, &options.height);
+      i++;
+    }
+    return options;
+  }
+
+private:
+  static bool isOption(const char *arg)
+  {
+    const char *const options[] = {"--headless", "--png", "--png-prefix", "--json", "--size"};
+    for (const char *option : options)
+      if (strcmp(arg, option) == 0)
+        return true;
+    return false;
+  }
+};
+
+/*
+ * GL context without a window or display, through EGL on Mesa's surfaceless platform (works
+ * with llvmpipe on machines without a GPU). Rendering goes to an OffscreenTarget since there
+ * is no default framebuffer. Needs the EGL headers at build time and libEGL at link time;
+ * without them Create reports the error and fails.
+ */
+class HeadlessContext
+{
+public:
+  ~HeadlessContext()
+  {
+    Destroy();
+  }
+
+  // a core profile context of the requested version, or 3.3 when that is unavailable
+  bool Create(int major, int minor)
+  {
+#ifdef HEADLESS_EGL
+    typedef EGLDisplay(EGLAPIENTRYP GetPlatformDisplayProc)(EGLenum platform, void *nativeDisplay, const EGLint *attributes);
+    const EGLenum PLATFORM_SURFACELESS_MESA = 0x31DD;
+    GetPlatformDisplayProc getPlatformDisplay = (GetPlatformDisplayProc)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+      display = getPlatformDisplay(PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+      display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+      cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED 0x" << hex << eglGetError() << dec << endl;
+      return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    // surfaceless contexts do not need a config, but take one when the platform has it
+    EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+    for (int attempt = 0; attempt < 2 && context == EGL_NO_CONTEXT; attempt++)
+    {
+      EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, attempt == 0 ? major : 3, EGL_CONTEXT_MINOR_VERSION, attempt == 0 ? minor : 3,
+                                    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+      context = eglCreateContext(display, configCount > 0 ? config : nullptr, EGL_NO_CONTEXT, contextAttributes);
+    }
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+      cout << "ERROR::HEADLESS::EGL_CONTEXT_FAILED 0x" << hex << eglGetError() << dec << endl;
+      Destroy();
+      return false;
+    }
+    return true;
+#else
+    cout << "ERROR::HEADLESS::EGL_UNAVAILABLE built without EGL" << endl;
+    return false;
+#endif
+  }
+
+  static GLADloadproc ProcAddressLoader()
+  {
+#ifdef HEADLESS_EGL
+    return (GLADloadproc)eglGetProcAddress;
+#else
+    return nullptr;
+#endif
+  }
+
+  void Destroy()
+  {
+#ifdef HEADLESS_EGL
+    if (display == EGL_NO_DISPLAY)
+      return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT)
+      eglDestroyContext(display, context);
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+#endif
+  }
+
+private:
+#ifdef HEADLESS_EGL
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
+
+// framebuffer object with RGBA8 color and 24-bit depth renderbuffers, for rendering without a window
+class OffscreenTarget
+{
+public:
+  unsigned int FBO = 0;
+  unsigned int width = 0, height = 0;
+
+  OffscreenTarget(unsigned int width, unsigned int height) : width(width), height(height)
+  {
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << endl;
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  ~OffscreenTarget()
+  {
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &FBO);
+  }
+
+  // binds the framebuffer and sets the viewport to cover it
+  void Bind()
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, width, height);
+  }
+
+  // reads the color buffer back and writes it as a PNG
+  bool WritePNG(const string &path)
+  {
+    vector<unsigned char> pixels(size_t(width) * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    return ::WritePNG(path, int(width), int(height), pixels.data());
+  }
+
+private:
+  unsigned int colorBuffer = 0;
+  unsigned int depthBuffer = 0;
+};
+
+#endif
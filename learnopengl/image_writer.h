@@ -0,0 +1,115 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Minimal PNG encoder for screenshots: 8-bit RGBA, no filtering, zlib "stored" blocks. The files
+ * are about as large as the raw pixels, which is fine for comparing benchmark frames and keeps
+ * the tree free of another image library.
+ */
+namespace png_detail
+{
+inline uint32_t Crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+{
+  static uint32_t table[256] = {};
+  if (table[1] == 0)
+    for (uint32_t n = 0; n < 256; n++)
+    {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+inline void PutU32(vector<unsigned char> &out, uint32_t value)
+{
+  out.push_back(static_cast<unsigned char>(value >> 24));
+  out.push_back(static_cast<unsigned char>(value >> 16));
+  out.push_back(static_cast<unsigned char>(value >> 8));
+  out.push_back(static_cast<unsigned char>(value));
+}
+
+inline void PutChunk(vector<unsigned char> &out, const char *type, const vector<unsigned char> &data)
+{
+  PutU32(out, static_cast<uint32_t>(data.size()));
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  PutU32(out, Crc32(&out[start], out.size() - start));
+}
+} // namespace png_detail
+
+// rgba is width * height * 4 bytes, rows bottom-up as glReadPixels returns them when flipY is set
+inline bool WritePNG(const string &path, int width, int height, const unsigned char *rgba, bool flipY = true)
+{
+  using namespace png_detail;
+  // scanlines, each prefixed with filter type 0
+  size_t rowBytes = size_t(width) * 4;
+  vector<unsigned char> raw;
+  raw.reserve((rowBytes + 1) * height);
+  for (int y = 0; y < height; y++)
+  {
+    const unsigned char *row = rgba + rowBytes * size_t(flipY ? height - 1 - y : y);
+    raw.push_back(0);
+    raw.insert(raw.end(), row, row + rowBytes);
+  }
+
+  // zlib stream of stored blocks (at most 65535 bytes each) plus Adler-32
+  vector<unsigned char> zlib = {0x78, 0x01};
+  for (size_t offset = 0; offset < raw.size() || offset == 0;)
+  {
+    size_t size = min<size_t>(raw.size() - offset, 65535);
+    bool last = offset + size == raw.size();
+    zlib.push_back(last ? 1 : 0);
+    zlib.push_back(static_cast<unsigned char>(size));
+    zlib.push_back(static_cast<unsigned char>(size >> 8));
+    zlib.push_back(static_cast<unsigned char>(~size));
+    zlib.push_back(static_cast<unsigned char>(~size >> 8));
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+    offset += size;
+    if (last)
+      break;
+  }
+  uint32_t a = 1, b = 0;
+  for (unsigned char byte : raw)
+  {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  PutU32(zlib, (b << 16) | a);
+
+  vector<unsigned char> header;
+  PutU32(header, static_cast<uint32_t>(width));
+  PutU32(header, static_cast<uint32_t>(height));
+  header.insert(header.end(), {8, 6, 0, 0, 0}); // 8-bit RGBA, deflate, no filter, no interlace
+
+  vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  PutChunk(png, "IHDR", header);
+  PutChunk(png, "IDAT", zlib);
+  PutChunk(png, "IEND", vector<unsigned char>());
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file || fwrite(png.data(), 1, png.size(), file) != png.size())
+  {
+    cout << "ERROR::IMAGE_WRITER::WRITE_FAILED " << path << endl;
+    if (file)
+      fclose(file);
+    return false;
+  }
+  fclose(file);
+  return true;
+}
+
+#endif
@@ -0,0 +1,402 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "gl_extensions.h"
+#include "lod.h"
+#include "material.h"
+#include "mesh.h"
+#include "mip_streamer.h"
+#include "model.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+using namespace std;
+
+// vertex attribute carrying the draw index (the command's baseInstance, divisor 1)
+const unsigned int DRAW_ID_ATTRIBUTE = 7;
+
+// layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// std430 per-draw data, "buffer DrawBlock" in the indirect shaders
+struct DrawData
+{
+  glm::mat4 model;
+  MaterialConstants constants;
+};
+
+/*
+ * Draws many models with as few calls as possible. On GL 4.3 every mesh becomes one indirect
+ * command; meshes are sorted by arena, index type and texture set, and each run sharing all
+ * three is submitted with a single glMultiDrawElementsIndirect. Per-draw transform and constants live in a
+ * storage buffer the vertex shader indexes with the draw index (baseInstance routed through
+ * DRAW_ID_ATTRIBUTE, which works without ARB_shader_draw_parameters). The number of calls
+ * depends on the distinct materials, not on how many models are drawn.
+ *
+ * With a frustum, Draw culls every mesh's world box first and sets the instanceCount of the
+ * hidden commands to 0, so the command order and the batches stay unchanged. With a LodView
+ * it also points each command's count/firstIndex at the LOD picked for that instance.
+ *
+ * Without GL 4.3, Draw falls back to one Model::Draw per instance with the "model" uniform,
+ * so the shader passed in must be the matching GL 3.3 variant.
+ */
+class IndirectDrawList
+{
+public:
+  bool Enabled = true; // use the GL 4.3 path when the context supports it
+
+  // stats of the last Draw
+  unsigned int drawCount = 0; // meshes drawn
+  unsigned int callCount = 0; // draw calls issued
+  unsigned int visibleCount = 0;
+  unsigned int culledCount = 0;
+  size_t submittedTriangles = 0; // as drawn
+  size_t fullTriangles = 0;      // the same meshes at LOD 0
+
+  // owns its buffers and the draw ID attribute it set on the shared arena VAOs
+  IndirectDrawList() = default;
+  IndirectDrawList(const IndirectDrawList &) = delete;
+  IndirectDrawList &operator=(const IndirectDrawList &) = delete;
+
+  ~IndirectDrawList()
+  {
+    Release();
+  }
+
+  static bool Supported()
+  {
+    return HasGLVersion(4, 3) && glMultiDrawElementsIndirect != nullptr;
+  }
+
+  bool Active() const
+  {
+    return Enabled && Supported();
+  }
+
+  // adds every mesh of model; returns an instance handle for SetTransform
+  unsigned int Add(Model &model, const glm::mat4 &transform)
+  {
+    unsigned int instance = static_cast<unsigned int>(instances.size());
+    instances.push_back(Instance{&model, transform});
+    for (Mesh &mesh : model.meshes)
+      items.push_back(Item{&mesh, instance, 0});
+    commandsDirty = true;
+    return instance;
+  }
+
+  // moves an instance without rebuilding the command buffer
+  void SetTransform(unsigned int instance, const glm::mat4 &transform)
+  {
+    instances[instance].transform = transform;
+    transformsDirty = true;
+  }
+
+  void Clear()
+  {
+    instances.clear();
+    items.clear();
+    commandsDirty = true;
+  }
+
+  // draws everything, or only what intersects frustum when one is given; lodView selects mesh LODs
+  void Draw(Shader &shader, const Frustum *frustum = nullptr, const LodView *lodView = nullptr)
+  {
+    drawCount = static_cast<unsigned int>(items.size());
+    callCount = 0;
+    visibleCount = drawCount;
+    culledCount = 0;
+    submittedTriangles = fullTriangles = 0;
+    if (!Active())
+    {
+      visibleCount = 0;
+      for (Instance &instance : instances)
+      {
+        instance.model->Draw(shader, instance.transform, frustum, lodView);
+        visibleCount += frustum ? instance.model->visibleCount : static_cast<unsigned int>(instance.model->meshes.size());
+        submittedTriangles += instance.model->submittedTriangles;
+        fullTriangles += instance.model->fullTriangles;
+      }
+      callCount = visibleCount;
+      culledCount = drawCount - visibleCount;
+      return;
+    }
+
+    // animated node hierarchies change the per-draw matrices too
+    for (Instance &instance : instances)
+      if (instance.model->nodes.Update() > 0)
+        transformsDirty = true;
+
+    if (commandsDirty)
+      buildCommands();
+    else if (transformsDirty)
+      uploadDrawData();
+    if (frustum || lodView)
+      updateCommands(frustum, lodView);
+    else if (commandsModified)
+      resetCommands();
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+      submittedTriangles += commands[i].instanceCount * commands[i].count / 3;
+      fullTriangles += commands[i].instanceCount * items[order[i]].mesh->range.indexCount / 3;
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+    for (const Batch &batch : batches)
+    {
+      if (frustum && !anyVisible(batch))
+        continue;
+      items[order[batch.first]].mesh->material.Bind(shader);
+      glBindVertexArray(batch.VAO);
+      configureDrawID(batch.VAO);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, batch.indexType, (void *)(batch.first * sizeof(DrawElementsIndirectCommand)),
+                                  GLsizei(batch.count), 0);
+      callCount++;
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // deletes the GL buffers; the list can be reused afterwards
+  void Release()
+  {
+    if (commandBuffer == 0)
+      return;
+    for (unsigned int VAO : configuredVAOs)
+    {
+      glBindVertexArray(VAO);
+      glDisableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+    }
+    glBindVertexArray(0);
+    glDeleteBuffers(1, &commandBuffer);
+    glDeleteBuffers(1, &drawDataBuffer);
+    glDeleteBuffers(1, &drawIDBuffer);
+    commandBuffer = drawDataBuffer = drawIDBuffer = 0;
+    drawIDCapacity = 0;
+    configuredVAOs.clear();
+    commandsDirty = true;
+  }
+
+private:
+  struct Instance
+  {
+    Model *model;
+    glm::mat4 transform;
+  };
+
+  struct Item
+  {
+    Mesh *mesh;
+    unsigned int instance;
+    unsigned int lod; // last selected, for LodView hysteresis
+  };
+
+  // consecutive commands sharing a VAO, index type and texture bindings
+  struct Batch
+  {
+    unsigned int VAO;
+    GLenum indexType;
+    size_t first;
+    size_t count;
+  };
+
+  vector<Instance> instances;
+  vector<Item> items;
+  vector<size_t> order; // items sorted into batches; command i draws items[order[i]]
+  vector<Batch> batches;
+  vector<DrawElementsIndirectCommand> commands;
+  vector<DrawData> draws;
+  FrustumCuller culler;
+  bool commandsModified = false; // instanceCount or LOD changed since buildCommands
+  bool commandsDirty = true;
+  bool transformsDirty = true;
+
+  unsigned int commandBuffer = 0, drawDataBuffer = 0, drawIDBuffer = 0;
+  size_t drawIDCapacity = 0;
+  vector<unsigned int> configuredVAOs; // arena VAOs with DRAW_ID_ATTRIBUTE pointing at drawIDBuffer
+
+  glm::mat4 meshTransform(const Item &item) const
+  {
+    const Instance &instance = instances[item.instance];
+    return instance.transform * instance.model->nodes.world[item.mesh->node];
+  }
+
+  static bool texturesBefore(const Material &a, const Material &b)
+  {
+    return lexicographical_compare(a.bindings.begin(), a.bindings.end(), b.bindings.begin(), b.bindings.end(),
+                                   [](const Material::Binding &x, const Material::Binding &y)
+                                   { return x.unit != y.unit ? x.unit < y.unit : x.textureID < y.textureID; });
+  }
+
+  void buildCommands()
+  {
+    if (commandBuffer == 0)
+    {
+      glGenBuffers(1, &commandBuffer);
+      glGenBuffers(1, &drawDataBuffer);
+    }
+
+    order.resize(items.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [this](size_t a, size_t b)
+    {
+      const Mesh &x = *items[a].mesh, &y = *items[b].mesh;
+      if (x.VAO != y.VAO)
+        return x.VAO < y.VAO;
+      if (x.range.indexType != y.range.indexType)
+        return x.range.indexType < y.range.indexType;
+      return texturesBefore(x.material, y.material);
+    });
+
+    commands.resize(order.size());
+    batches.clear();
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      const Mesh &mesh = *items[order[i]].mesh;
+      commands[i] = DrawElementsIndirectCommand{GLuint(mesh.range.indexCount), 1, GLuint(mesh.range.firstIndex),
+                                                GLint(mesh.range.baseVertex), GLuint(i)};
+      const Mesh *previous = i > 0 ? items[order[i - 1]].mesh : nullptr;
+      if (previous && previous->VAO == mesh.VAO && previous->range.indexType == mesh.range.indexType &&
+          previous->material.SameTextures(mesh.material))
+        batches.back().count++;
+      else
+        batches.push_back(Batch{mesh.VAO, mesh.range.indexType, i, 1});
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    reserveDrawIDs(order.size());
+    uploadDrawData();
+    commandsDirty = false;
+    commandsModified = false;
+  }
+
+  // hides commands whose world box is outside the frustum by zeroing their instanceCount and
+  // points the rest at the LOD lodView picks for them, requesting their mips from the MipStreamer
+  void updateCommands(const Frustum *frustum, const LodView *lodView)
+  {
+    if (frustum)
+    {
+      culler.Resize(order.size());
+      for (size_t i = 0; i < order.size(); i++)
+      {
+        const Item &item = items[order[i]];
+        culler.Set(i, TransformBounds(item.mesh->bounds, meshTransform(item)));
+      }
+      culler.Cull(*frustum);
+      visibleCount = culler.visibleCount;
+      culledCount = culler.culledCount;
+    }
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      Item &item = items[order[i]];
+      const Mesh &mesh = *item.mesh;
+      commands[i].instanceCount = frustum ? culler.visible[i] : 1;
+      bool requestMips = lodView && commands[i].instanceCount && MipStreamer::Instance().Enabled;
+      if (lodView && (mesh.LodCount() > 1 || requestMips))
+      {
+        BoundingSphere sphere = TransformBounds(mesh.sphere, meshTransform(item));
+        if (mesh.LodCount() > 1)
+          item.lod = lodView->Select(mesh.lodErrors, sphere, item.lod);
+        if (requestMips)
+          RequestMeshMips(mesh, sphere, *lodView);
+      }
+      const GeometryRange &range = mesh.LodRange(lodView ? item.lod : 0);
+      commands[i].count = GLuint(range.indexCount);
+      commands[i].firstIndex = GLuint(range.firstIndex);
+    }
+    uploadCommands();
+    commandsModified = true;
+  }
+
+  void resetCommands()
+  {
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      const GeometryRange &range = items[order[i]].mesh->range;
+      commands[i] = DrawElementsIndirectCommand{GLuint(range.indexCount), 1, GLuint(range.firstIndex), GLint(range.baseVertex),
+                                                GLuint(i)};
+    }
+    uploadCommands();
+    commandsModified = false;
+  }
+
+  void uploadCommands()
+  {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+
+  bool anyVisible(const Batch &batch) const
+  {
+    for (size_t i = batch.first; i < batch.first + batch.count; i++)
+      if (culler.visible[i])
+        return true;
+    return false;
+  }
+
+  void uploadDrawData()
+  {
+    draws.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      const Item &item = items[order[i]];
+      draws[i].model = meshTransform(item);
+      draws[i].constants = item.mesh->material.constants;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(DrawData), draws.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    transformsDirty = false;
+  }
+
+  // fills drawIDBuffer with 0, 1, 2, ... so attribute instance i reads i
+  void reserveDrawIDs(size_t count)
+  {
+    if (count <= drawIDCapacity)
+      return;
+    drawIDCapacity = max<size_t>(count, drawIDCapacity * 2);
+    vector<GLuint> ids(drawIDCapacity);
+    iota(ids.begin(), ids.end(), 0u);
+    if (drawIDBuffer == 0)
+      glGenBuffers(1, &drawIDBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // the VAO must be bound; the attribute is per VAO, so each arena is set up once
+  void configureDrawID(unsigned int VAO)
+  {
+    if (find(configuredVAOs.begin(), configuredVAOs.end(), VAO) != configuredVAOs.end())
+      return;
+    glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+    glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+    glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void *)0);
+    glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    configuredVAOs.push_back(VAO);
+  }
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef INSTANCED_MODEL_H
+#define INSTANCED_MODEL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "model.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// first of the four vertex attributes (columns) holding the per-instance model matrix
+const unsigned int INSTANCE_MATRIX_ATTRIBUTE = 8;
+
+/*
+ * Draws many copies of one Model with a single glDrawElementsInstancedBaseVertex per mesh.
+ * Instance transforms live in a GPU buffer read through an instanced mat4 attribute at
+ * INSTANCE_MATRIX_ATTRIBUTE; the shader computes instance * model, where "model" is the
+ * mesh's node transform. Changing a transform only marks its range, and Draw uploads the
+ * merged dirty ranges with glBufferSubData instead of the whole buffer.
+ *
+ * The arena VAOs are shared with other draws, so the instance attributes are pointed at this
+ * model's buffer for the duration of Draw and disabled again afterwards.
+ */
+class InstancedModel
+{
+public:
+  Model *model;
+  vector<glm::mat4> transforms;
+
+  // stats of the last Draw
+  unsigned int callCount = 0;
+  size_t uploadedBytes = 0;
+
+  InstancedModel(Model &model, vector<glm::mat4> transforms = vector<glm::mat4>()) : model(&model), transforms(std::move(transforms))
+  {
+    markDirty(0, this->transforms.size());
+  }
+
+  size_t Size() const
+  {
+    return transforms.size();
+  }
+
+  // appends an instance; returns its index
+  size_t Add(const glm::mat4 &transform)
+  {
+    transforms.push_back(transform);
+    markDirty(transforms.size() - 1, transforms.size());
+    return transforms.size() - 1;
+  }
+
+  void SetTransform(size_t instance, const glm::mat4 &transform)
+  {
+    transforms[instance] = transform;
+    markDirty(instance, instance + 1);
+  }
+
+  // overwrites count transforms starting at first
+  void SetTransforms(size_t first, const glm::mat4 *data, size_t count)
+  {
+    copy(data, data + count, transforms.begin() + first);
+    markDirty(first, first + count);
+  }
+
+  void Draw(Shader &shader)
+  {
+    callCount = 0;
+    Upload();
+    if (transforms.empty())
+      return;
+
+    model->nodes.Update();
+    unsigned int boundVAO = 0;
+    int boundNode = -1;
+    for (Mesh &mesh : model->meshes)
+    {
+      if (int(mesh.node) != boundNode)
+      {
+        boundNode = mesh.node;
+        shader.setMat4("model"_u, model->nodes.world[mesh.node]);
+      }
+      mesh.material.Bind(shader);
+      if (mesh.VAO != boundVAO)
+      {
+        if (boundVAO != 0)
+          DisableInstanceAttributes();
+        boundVAO = mesh.VAO;
+        glBindVertexArray(boundVAO);
+        EnableInstanceAttributes(buffer);
+      }
+      mesh.DrawInstanced(GLsizei(transforms.size()));
+      callCount++;
+    }
+    if (boundVAO != 0)
+      DisableInstanceAttributes();
+
+    // reset
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // uploads the changed transforms and returns the instance buffer; Draw calls it
+  unsigned int Upload()
+  {
+    uploadedBytes = 0;
+    if (transforms.size() > capacity)
+    {
+      // reallocate with headroom and upload everything
+      capacity = max(transforms.size(), capacity * 2);
+      if (buffer == 0)
+        glGenBuffers(1, &buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      uploadedBytes = transforms.size() * sizeof(glm::mat4);
+      dirty.clear();
+      return buffer;
+    }
+    if (dirty.empty())
+      return buffer;
+
+    // merge overlapping and touching ranges, then upload each once
+    sort(dirty.begin(), dirty.end());
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (size_t i = 0; i < dirty.size();)
+    {
+      size_t first = dirty[i].first, end = dirty[i].second;
+      for (i++; i < dirty.size() && dirty[i].first <= end; i++)
+        end = max(end, dirty[i].second);
+      end = min(end, transforms.size());
+      if (first < end)
+      {
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::mat4), (end - first) * sizeof(glm::mat4), &transforms[first]);
+        uploadedBytes += (end - first) * sizeof(glm::mat4);
+      }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    dirty.clear();
+    return buffer;
+  }
+
+  // deletes the instance buffer; the next Draw uploads everything again
+  void Release()
+  {
+    if (buffer != 0)
+      glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    capacity = 0;
+    dirty.clear();
+    markDirty(0, transforms.size());
+  }
+
+  // points the instance matrix attributes of the bound VAO at buffer
+  static void EnableInstanceAttributes(unsigned int buffer)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+      glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIBUTE + column);
+      glVertexAttribPointer(INSTANCE_MATRIX_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void *)(column * sizeof(glm::vec4)));
+      glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIBUTE + column, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  static void DisableInstanceAttributes()
+  {
+    for (unsigned int column = 0; column < 4; column++)
+    {
+      glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIBUTE + column, 0);
+      glDisableVertexAttribArray(INSTANCE_MATRIX_ATTRIBUTE + column);
+    }
+  }
+
+private:
+  unsigned int buffer = 0;
+  size_t capacity = 0;                 // instances the buffer can hold
+  vector<pair<size_t, size_t>> dirty;  // [first, end) instance ranges changed since the last upload
+
+  void markDirty(size_t first, size_t end)
+  {
+    if (first >= end)
+      return;
+    // consecutive updates usually extend the previous range
+    if (!dirty.empty() && first <= dirty.back().second && end >= dirty.back().first)
+    {
+      dirty.back().first = min(dirty.back().first, first);
+      dirty.back().second = max(dirty.back().second, end);
+      return;
+    }
+    dirty.emplace_back(first, end);
+  }
+};
+
+#endif
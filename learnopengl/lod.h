@@ -0,0 +1,54 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// camera data needed to pick mesh LODs, see Camera::GetLodView
+struct LodView
+{
+  glm::vec3 position;
+  float pixelsPerUnit = 0.0f; // screen pixels covered by one world unit at distance 1
+  float pixelError = 1.0f;    // largest simplification error allowed on screen, in pixels
+  float hysteresis = 0.25f;   // switching to a coarser LOD needs this much margin below pixelError
+
+  // radius in pixels of a world-space sphere seen from position
+  float ProjectedRadius(const BoundingSphere &sphere) const
+  {
+    float distance = max(glm::length(sphere.center - position) - sphere.radius, 1e-3f);
+    return sphere.radius * pixelsPerUnit / distance;
+  }
+
+  // world units covered by one pixel at the sphere's nearest point
+  float UnitsPerPixel(const BoundingSphere &sphere) const
+  {
+    float distance = max(glm::length(sphere.center - position) - sphere.radius, 1e-3f);
+    return distance / pixelsPerUnit;
+  }
+
+  /*
+   * errors[l] is LOD l's simplification error relative to the mesh's bounding sphere radius
+   * (errors[0] = 0), so errors[l] * projected radius is the error in pixels. Returns the
+   * coarsest LOD under pixelError; moving coarser than current needs the hysteresis margin,
+   * which keeps meshes from flickering between two LODs near a threshold.
+   */
+  unsigned int Select(const vector<float> &errors, const BoundingSphere &sphere, unsigned int current) const
+  {
+    float radius = ProjectedRadius(sphere);
+    for (unsigned int lod = static_cast<unsigned int>(errors.size()) - 1; lod > 0; lod--)
+    {
+      float allowed = lod > current ? pixelError * (1.0f - hysteresis) : pixelError;
+      if (errors[lod] * radius <= allowed)
+        return lod;
+    }
+    return 0;
+  }
+};
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bindless.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Texture
+{
+  unsigned int id;
+  string type;
+  string path;
+};
+
+// Texture slots a material can fill; a mesh uses up to MATERIAL_SLOT_TEXTURES textures per slot
+enum MaterialSlot
+{
+  SLOT_DIFFUSE,
+  SLOT_SPECULAR,
+  SLOT_NORMAL,
+  SLOT_HEIGHT,
+  MATERIAL_SLOT_COUNT
+};
+
+const unsigned int MATERIAL_SLOT_TEXTURES = 4;
+const unsigned int MATERIAL_TEXTURE_UNITS = MATERIAL_SLOT_COUNT * MATERIAL_SLOT_TEXTURES;
+
+const char *const MATERIAL_SLOT_TYPES[MATERIAL_SLOT_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+
+/*
+ * std140 per-mesh constants, bound as "uniform MaterialBlock" in the shaders.
+ * Mesh fills the vertex decode terms, the importer fills the material colours.
+ */
+struct MaterialConstants
+{
+  glm::vec4 diffuseColor = glm::vec4(1.0f);
+  glm::vec4 specularColor = glm::vec4(1.0f, 1.0f, 1.0f, 32.0f); // w = shininess
+  glm::vec4 positionScale = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);  // w = 1 for the packed vertex layout
+  glm::vec4 positionOffset = glm::vec4(0.0f);
+  glm::ivec4 layers = glm::ivec4(-1); // per slot, the layer sampled from the slot's texture array; -1 samples texture_<type>1
+};
+
+/*
+ * std140 "uniform MaterialTextureBlock" of the bindless shaders: per slot, xy is the handle of
+ * texture_<type>1 and zw the handle of texture_<type>_array (low word first). A zero handle makes
+ * the shader sample the bound unit instead.
+ */
+struct MaterialHandles
+{
+  glm::uvec4 textures[MATERIAL_SLOT_COUNT] = {};
+};
+
+/*
+ * Texture bindings and constants of one mesh, resolved once at load time.
+ *
+ * Every sampler name maps to a fixed texture unit ("texture_diffuse1" -> 0, "texture_specular1"
+ * -> 4, ...), so the sampler uniforms of a program only need to be set the first time any
+ * material is bound with it (Shader::materialConfigured). The block itself is attached to
+ * MATERIAL_BLOCK_BINDING by Shader. Bind() is then a flat list of glBindTexture calls plus one
+ * glBindBufferBase, without strings or allocation.
+ *
+ * UseArray replaces a slot's first texture with a layer of a GL_TEXTURE_2D_ARRAY ("<type>_array"
+ * in the shaders, see TextureArrays), so meshes whose textures were packed together end up with
+ * identical bindings and can be drawn without rebinding.
+ *
+ * Programs declaring MaterialTextureBlock get the textures as bindless handles instead (see
+ * BindlessTextures): once every sampled texture has a resident handle, Bind() skips the
+ * glBindTexture calls and only binds the two buffers. Until then the block holds zero handles and
+ * the textures are bound as usual.
+ */
+class Material
+{
+public:
+  struct Binding
+  {
+    unsigned int unit;
+    unsigned int textureID;
+    GLenum target = GL_TEXTURE_2D;
+  };
+
+  vector<Binding> bindings;
+  MaterialConstants constants;
+  unsigned int UBO = 0;
+  unsigned int handleUBO = 0; // MaterialHandles, created when the driver supports bindless textures
+
+  // builds the binding table from textures typed "texture_diffuse", "texture_specular", ...
+  void Build(const vector<Texture> &textures, const MaterialConstants &materialConstants)
+  {
+    unsigned int count[MATERIAL_SLOT_COUNT] = {};
+    bindings.clear();
+    for (const Texture &texture : textures)
+    {
+      unsigned int slot = 0;
+      while (slot < MATERIAL_SLOT_COUNT && texture.type != MATERIAL_SLOT_TYPES[slot])
+        slot++;
+      if (slot == MATERIAL_SLOT_COUNT || count[slot] == MATERIAL_SLOT_TEXTURES)
+      {
+        cout << "WARNING::MATERIAL:: no sampler slot for " << texture.type << " " << texture.path << endl;
+        continue;
+      }
+      bindings.push_back(Binding{UnitFor(slot, count[slot]++), texture.id});
+    }
+    constants = materialConstants;
+    Update();
+  }
+
+  // bound is the material drawn just before, whose textures are not bound again when they are the same
+  void Bind(const Shader &shader, const Material *bound = nullptr) const
+  {
+    if (!shader.materialConfigured)
+      configureProgram(shader);
+    bool bindless = false;
+    if (handleUBO != 0 && shader.materialHandles)
+    {
+      bindless = resolveHandles();
+      glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_TEXTURE_BLOCK_BINDING, handleUBO);
+    }
+    if (!bound || !SameTextures(*bound))
+    {
+      if (bindless)
+        BindlessTextures::Instance().bindsAvoided += unsigned(bindings.size());
+      else
+      {
+        for (const Binding &binding : bindings)
+        {
+          glActiveTexture(GL_TEXTURE0 + binding.unit);
+          glBindTexture(binding.target, binding.textureID);
+        }
+      }
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, UBO);
+  }
+
+  bool SameTextures(const Material &other) const
+  {
+    if (bindings.size() != other.bindings.size())
+      return false;
+    for (size_t i = 0; i < bindings.size(); i++)
+      if (bindings[i].unit != other.bindings[i].unit || bindings[i].textureID != other.bindings[i].textureID)
+        return false;
+    return true;
+  }
+
+  // samples layer of arrayID instead of the slot's first texture
+  void UseArray(unsigned int slot, unsigned int arrayID, int layer)
+  {
+    bindings.erase(remove_if(bindings.begin(), bindings.end(), [&](const Binding &b) { return b.unit == UnitFor(slot, 0); }), bindings.end());
+    bindings.push_back(Binding{ArrayUnitFor(slot), arrayID, GL_TEXTURE_2D_ARRAY});
+    sort(bindings.begin(), bindings.end(), [](const Binding &a, const Binding &b) { return a.unit < b.unit; });
+    constants.layers[slot] = layer;
+    Update();
+    if (handlesResident)
+    {
+      handlesResident = false;
+      uploadHandles(MaterialHandles());
+    }
+  }
+
+  // uploads constants after they changed
+  void Update()
+  {
+    if (UBO == 0)
+      glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialConstants), &constants, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    if (handleUBO == 0 && BindlessTextures::Instance().Supported())
+    {
+      glGenBuffers(1, &handleUBO);
+      uploadHandles(MaterialHandles());
+    }
+  }
+
+  // deletes the constant and handle buffers; the textures belong to whoever loaded them
+  void Release()
+  {
+    if (UBO != 0)
+      glDeleteBuffers(1, &UBO);
+    if (handleUBO != 0)
+      glDeleteBuffers(1, &handleUBO);
+    UBO = handleUBO = 0;
+    handlesResident = false;
+  }
+
+  static unsigned int UnitFor(unsigned int slot, unsigned int number)
+  {
+    return slot * MATERIAL_SLOT_TEXTURES + number;
+  }
+
+  // unit of a slot's texture array; shared with texture_<type>4, which the array shaders do not sample,
+  // so everything stays within the 16 units GL 3.3 guarantees
+  static unsigned int ArrayUnitFor(unsigned int slot)
+  {
+    return UnitFor(slot, MATERIAL_SLOT_TEXTURES - 1);
+  }
+
+private:
+  mutable bool handlesResident = false;
+
+  // writes the handles of every texture the bindless shaders sample; false while one of them has to be bound
+  bool resolveHandles() const
+  {
+    BindlessTextures &bindless = BindlessTextures::Instance();
+    if (!bindless.Active())
+      return false;
+    if (handlesResident)
+      return true;
+    MaterialHandles handles;
+    for (const Binding &binding : bindings)
+    {
+      unsigned int slot = binding.unit / MATERIAL_SLOT_TEXTURES;
+      bool array = binding.target == GL_TEXTURE_2D_ARRAY;
+      if (!array && binding.unit != UnitFor(slot, 0))
+        continue; // texture_<type>2..4 are not sampled through handles
+      GLuint64 handle = bindless.Handle(binding.textureID);
+      if (handle == 0)
+        return false;
+      glm::uvec4 &entry = handles.textures[slot];
+      (array ? entry.z : entry.x) = uint32_t(handle);
+      (array ? entry.w : entry.y) = uint32_t(handle >> 32);
+    }
+    uploadHandles(handles);
+    handlesResident = true;
+    return true;
+  }
+
+  void uploadHandles(const MaterialHandles &handles) const
+  {
+    glBindBuffer(GL_UNIFORM_BUFFER, handleUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialHandles), &handles, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // points every texture_<type><n> sampler at its fixed unit; the program must be in use
+  static void configureProgram(const Shader &shader)
+  {
+    unsigned int program = shader.ID;
+    char name[64];
+    for (unsigned int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+    {
+      for (unsigned int number = 0; number < MATERIAL_SLOT_TEXTURES; number++)
+      {
+        snprintf(name, sizeof(name), "%s%u", MATERIAL_SLOT_TYPES[slot], number + 1);
+        GLint location = glGetUniformLocation(program, name);
+        if (location != -1)
+          glUniform1i(location, UnitFor(slot, number));
+      }
+      snprintf(name, sizeof(name), "%s_array", MATERIAL_SLOT_TYPES[slot]);
+      GLint location = glGetUniformLocation(program, name);
+      if (location != -1)
+        glUniform1i(location, ArrayUnitFor(slot));
+    }
+    shader.materialConfigured = true;
+  }
+};
+
+#endif
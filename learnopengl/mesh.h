@@ -4,130 +4,153 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bounds.h"
+#include "geometry_arena.h"
+#include "lod.h"
+#include "material.h"
 #include "shader.h"
+#include "vertex.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex
+// a coarser index buffer over the same vertices, from SimplifyMesh
+struct MeshLod
 {
-  glm::vec3 Position;
-  glm::vec3 Normal;
-  glm::vec2 TexCoords;
-  glm::vec3 Tangent;
-  glm::vec3 Bitangent;
-
-  int m_BoneIds[MAX_BONE_INFLUENCE];
-  float m_Weights[MAX_BONE_INFLUENCE];
-};
-
-struct Texture
-{
-  unsigned int id;
-  string type;
-  string path;
+  vector<unsigned int> indices;
+  GeometryRange range;
 };
 
 class Mesh
 {
 public:
+  // upload meshes without bone weights in the PackedVertex layout
+  static inline bool PackVertices = true;
+  // upload indices as GL_UNSIGNED_SHORT when the mesh has at most MAX_SHORT_INDEX_VERTICES vertices
+  static inline bool ShortIndices = true;
+
   vector<Vertex> vertices;
   vector<unsigned int> indices;
   vector<Texture> textures;
-  unsigned int VAO;
-
-  // Constructor
-  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+  Material material;
+  unsigned int VAO;  // shared by every mesh in the same arena
+  bool packed = false;
+  GeometryArena *arena = nullptr;
+  GeometryRange range;
+  AABB bounds;           // object space, filled by the loader
+  BoundingSphere sphere; // object space, filled by the loader
+  unsigned int node = 0; // Model::nodes entry the mesh is attached to
+  float uvDensity = 0.0f; // texture coordinate units per object-space unit, filled by the loader
+  vector<MeshLod> lods;   // LOD 1, 2, ...; LOD 0 is indices/range
+  vector<float> lodErrors{0.0f}; // per LOD, simplification error relative to sphere.radius
+
+  // Constructor; geometry is sub-allocated from arenas, or from GeometryArenas::Scene() when null
+  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MaterialConstants constants = MaterialConstants(),
+       GeometryArenas *arenas = nullptr)
   {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+    this->textures = std::move(textures);
 
-    setupMesh();
+    setupMesh(constants, arenas ? *arenas : GeometryArenas::Scene());
   }
 
-  void Draw(Shader shader)
+  // bytes per vertex as uploaded to the GPU
+  size_t VertexStride() const
   {
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    unsigned int normalNr = 1;
-    unsigned int heightNr = 1;
+    return ::VertexStride(format());
+  }
 
-    for (unsigned int i = 0; i < textures.size(); i++)
-    {
-      glActiveTexture(GL_TEXTURE0 + i);
-      string number;
-      string name = textures[i].type;
-      if (name == "texture_diffuse")
-        number = to_string(diffuseNr++);
-      else if (name == "texture_specular")
-        number = to_string(specularNr++);
-      else if (name == "texture_normal")
-        number = to_string(normalNr++);
-      else if (name == "texture_height")
-        number = to_string(heightNr++);
-
-      glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-      glBindTexture(GL_TEXTURE_2D, textures[i].id);
-    }
+  VertexFormat format() const
+  {
+    return packed ? VERTEX_PACKED : VERTEX_FULL;
+  }
+
+  void Draw(const Shader &shader)
+  {
+    material.Bind(shader);
 
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    DrawRange();
 
     // reset
     glBindVertexArray(0);
     glActiveTexture(GL_TEXTURE0);
   }
 
-private:
-  unsigned int VBO, EBO;
-
-  void setupMesh()
+  // issues the draw call only; material and VAO must already be bound
+  void DrawRange(unsigned int lod = 0) const
   {
-    /*
-     * Buffer initialize
-     */
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    const GeometryRange &drawn = LodRange(lod);
+    glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(drawn.indexCount), drawn.indexType, (void *)drawn.IndexOffset(),
+                             GLint(drawn.baseVertex));
+  }
 
-    /*
-     * Set vertex attributes
-     * Position, Normal, texture coords, tangent, bitangent, id, weight
-     */
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+  // draws instanceCount copies; material and VAO must already be bound
+  void DrawInstanced(GLsizei instanceCount, unsigned int lod = 0) const
+  {
+    const GeometryRange &drawn = LodRange(lod);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, GLsizei(drawn.indexCount), drawn.indexType, (void *)drawn.IndexOffset(),
+                                      instanceCount, GLint(drawn.baseVertex));
+  }
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+  unsigned int LodCount() const
+  {
+    return static_cast<unsigned int>(lodErrors.size());
+  }
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+  const GeometryRange &LodRange(unsigned int lod) const
+  {
+    return lod == 0 ? range : lods[lod - 1].range;
+  }
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
+  // uploads the next coarser LOD; indices refer to this mesh's vertices
+  void AddLod(vector<unsigned int> lodIndices, float error)
+  {
+    MeshLod lod;
+    lod.indices = std::move(lodIndices);
+    lod.range = arena->AllocateIndices(range, lod.indices.data(), lod.indices.size());
+    lods.push_back(std::move(lod));
+    lodErrors.push_back(error);
+  }
 
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+  // returns the mesh's vertex and index ranges to its arena
+  void FreeGeometry()
+  {
+    if (arena)
+    {
+      arena->Free(range);
+      for (const MeshLod &lod : lods)
+        arena->Free(lod.range);
+    }
+    arena = nullptr;
+    range = GeometryRange();
+    lods.clear();
+    lodErrors.resize(1);
+  }
 
-    glEnableVertexAttribArray(5);
-    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void *)offsetof(Vertex, m_BoneIds));
+private:
+  void setupMesh(MaterialConstants constants, GeometryArenas &arenas)
+  {
+    packed = Mesh::PackVertices && !HasBoneWeights(vertices);
+    arena = &arenas.For(format());
 
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, m_Weights));
+    if (packed)
+    {
+      vector<PackedVertex> packedVertices = PackVertexData(vertices, constants);
+      range = arena->Allocate(packedVertices.data(), packedVertices.size(), indices.data(), indices.size(), Mesh::ShortIndices);
+    }
+    else
+    {
+      range = arena->Allocate(vertices.data(), vertices.size(), indices.data(), indices.size(), Mesh::ShortIndices);
+      constants.positionScale = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+      constants.positionOffset = glm::vec4(0.0f);
+    }
+    VAO = arena->VAO;
 
-    glBindVertexArray(0);
+    material.Build(textures, constants);
   }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,342 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+#include "file_map.h"
+#include "scene_graph.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+/*
+ * Binary mesh cache written next to a model source file (nanosuit.obj -> nanosuit.obj.meshcache).
+ *
+ * Layout (all offsets from the start of the file, every block 16-byte aligned):
+ *   MeshCacheHeader
+ *   MeshCacheEntry[meshCount] (including the mesh's MaterialConstants and node)
+ *   MeshCacheNode[nodeCount], node names
+ *   per mesh: texture records, Vertex[vertexCount], unsigned int[indexCount], then the
+ *             indices of LOD 1..lodCount-1 back to back (lodIndexCount[l] each)
+ *
+ * A texture record is { uint32 typeLength, uint32 pathLength, type chars, path chars }.
+ * The cache is only valid for the exact source bytes, import flags, build options, format
+ * version and Vertex layout it was written with; anything else is treated as a miss.
+ */
+const char MESH_CACHE_MAGIC[4] = {'L', 'O', 'G', 'M'};
+const uint32_t MESH_CACHE_VERSION = 6;
+const uint32_t MESH_CACHE_MAX_LODS = 8;
+
+struct MeshCacheHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t importFlags;
+  uint32_t vertexSize;
+  uint32_t meshCount;
+  uint32_t nodeCount;
+  uint32_t options; // loader post-processing applied before writing, e.g. MODEL_CACHE_OPTIMIZED
+  uint32_t reserved;
+};
+
+struct MeshCacheEntry
+{
+  uint64_t textureOffset;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  uint32_t textureCount;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t node;
+  uint32_t lodCount; // including LOD 0
+  uint32_t lodIndexCount[MESH_CACHE_MAX_LODS];
+  float lodError[MESH_CACHE_MAX_LODS];
+  MaterialConstants constants;
+};
+
+// one scene graph node, stored in depth-first order
+struct MeshCacheNode
+{
+  int32_t parent;
+  uint32_t nameLength;
+  uint64_t nameOffset;
+  glm::mat4 local;
+};
+
+// A mesh as stored in the cache; vertices and indices point into the mapped file
+struct CachedMesh
+{
+  const Vertex *vertices;
+  uint32_t vertexCount;
+  const unsigned int *indices;
+  uint32_t indexCount;
+  vector<Texture> textures; // only type and path are filled in
+  MaterialConstants constants;
+  uint32_t node;
+  vector<const unsigned int *> lodIndices; // LOD 1, 2, ...
+  vector<uint32_t> lodIndexCounts;
+  vector<float> lodErrors;
+};
+
+class MeshCache
+{
+public:
+  vector<CachedMesh> meshes;
+  SceneGraph nodes;
+
+  // cache file used for a given model source path
+  static string PathFor(const string &sourcePath)
+  {
+    return sourcePath + ".meshcache";
+  }
+
+  /*
+   * hash of the model file and, for Wavefront .obj, of every material library it names with
+   * mtllib, since texture paths and material colours come from there; 0 if the model cannot be read
+   */
+  static uint64_t SourceHash(const string &sourcePath)
+  {
+    MappedFile file;
+    if (!file.open(sourcePath))
+      return 0;
+    uint64_t hash = fnv1a64(file.data, file.size);
+    size_t dot = sourcePath.find_last_of('.');
+    string extension = dot == string::npos ? "" : sourcePath.substr(dot);
+    if (extension != ".obj" && extension != ".OBJ")
+      return hash;
+
+    string directory = sourcePath.substr(0, sourcePath.find_last_of('/') + 1);
+    const char *line = file.data;
+    const char *end = file.data + file.size;
+    while (line < end)
+    {
+      const char *lineEnd = static_cast<const char *>(memchr(line, '\n', end - line));
+      if (!lineEnd)
+        lineEnd = end;
+      if (lineEnd - line > 7 && strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+      {
+        istringstream names(string(line + 7, lineEnd));
+        string name;
+        while (names >> name)
+        {
+          uint64_t library = HashFile(directory + name);
+          hash = fnv1a64(&library, sizeof(library), hash);
+        }
+      }
+      line = lineEnd + 1;
+    }
+    return hash;
+  }
+
+  /*
+   * Maps the cache file and validates it against the expected key. On success meshes
+   * points into the mapping, which stays alive until this object is destroyed.
+   */
+  bool Load(const string &cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t options = 0)
+  {
+    meshes.clear();
+    nodes.Clear();
+    if (!file.open(cachePath) || file.size < sizeof(MeshCacheHeader))
+      return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION ||
+        header.sourceHash != sourceHash || header.importFlags != importFlags || header.options != options ||
+        header.vertexSize != sizeof(Vertex))
+      return false;
+
+    uint64_t nodeOffset = nodeTableOffset(header.meshCount);
+    if (nodeOffset + uint64_t(header.nodeCount) * sizeof(MeshCacheNode) > file.size)
+      return invalid(cachePath);
+
+    const MeshCacheNode *records = reinterpret_cast<const MeshCacheNode *>(file.data + nodeOffset);
+    for (uint32_t i = 0; i < header.nodeCount; i++)
+    {
+      const MeshCacheNode &record = records[i];
+      if (record.nameOffset + record.nameLength > file.size || record.parent >= int32_t(i))
+        return invalid(cachePath);
+      if (nodes.AddNode(record.parent, record.local, string(file.data + record.nameOffset, record.nameLength)) < 0)
+        return invalid(cachePath);
+    }
+
+    const MeshCacheEntry *entries = reinterpret_cast<const MeshCacheEntry *>(file.data + sizeof(MeshCacheHeader));
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+      const MeshCacheEntry &entry = entries[i];
+      uint64_t lodIndexCount = 0;
+      for (uint32_t l = 1; l < entry.lodCount && l < MESH_CACHE_MAX_LODS; l++)
+        lodIndexCount += entry.lodIndexCount[l];
+      if (entry.vertexOffset + uint64_t(entry.vertexCount) * sizeof(Vertex) > file.size ||
+          entry.indexOffset + (uint64_t(entry.indexCount) + lodIndexCount) * sizeof(unsigned int) > file.size ||
+          (header.nodeCount > 0 && entry.node >= header.nodeCount) || entry.lodCount > MESH_CACHE_MAX_LODS)
+        return invalid(cachePath);
+
+      CachedMesh mesh;
+      mesh.vertices = reinterpret_cast<const Vertex *>(file.data + entry.vertexOffset);
+      mesh.vertexCount = entry.vertexCount;
+      mesh.indices = reinterpret_cast<const unsigned int *>(file.data + entry.indexOffset);
+      mesh.indexCount = entry.indexCount;
+      mesh.constants = entry.constants;
+      mesh.node = entry.node;
+      const unsigned int *lodIndices = mesh.indices + entry.indexCount;
+      for (uint32_t l = 1; l < entry.lodCount; l++)
+      {
+        mesh.lodIndices.push_back(lodIndices);
+        mesh.lodIndexCounts.push_back(entry.lodIndexCount[l]);
+        mesh.lodErrors.push_back(entry.lodError[l]);
+        lodIndices += entry.lodIndexCount[l];
+      }
+
+      uint64_t offset = entry.textureOffset;
+      for (uint32_t t = 0; t < entry.textureCount; t++)
+      {
+        uint32_t lengths[2];
+        if (offset + sizeof(lengths) > file.size)
+          return invalid(cachePath);
+        memcpy(lengths, file.data + offset, sizeof(lengths));
+        offset += sizeof(lengths);
+        if (offset + lengths[0] + lengths[1] > file.size)
+          return invalid(cachePath);
+        Texture texture;
+        texture.id = 0;
+        texture.type.assign(file.data + offset, lengths[0]);
+        texture.path.assign(file.data + offset + lengths[0], lengths[1]);
+        offset += lengths[0] + lengths[1];
+        mesh.textures.push_back(texture);
+      }
+      meshes.push_back(mesh);
+    }
+    return true;
+  }
+
+  // serializes the given meshes and their node hierarchy; returns false if the file could not be written
+  static bool Write(const string &cachePath, uint64_t sourceHash, uint32_t importFlags, const vector<Mesh> &meshes,
+                    const SceneGraph &nodes = SceneGraph(), uint32_t options = 0)
+  {
+    MeshCacheHeader header = {};
+    memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.importFlags = importFlags;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.nodeCount = static_cast<uint32_t>(nodes.Size());
+    header.options = options;
+
+    vector<MeshCacheNode> records(nodes.Size());
+    uint64_t offset = nodeTableOffset(header.meshCount) + records.size() * sizeof(MeshCacheNode);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+      records[i] = MeshCacheNode{nodes.parents[i], static_cast<uint32_t>(nodes.names[i].size()), offset, nodes.local[i]};
+      offset += nodes.names[i].size();
+    }
+
+    vector<MeshCacheEntry> entries(meshes.size());
+    offset = align(offset);
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+      const Mesh &mesh = meshes[i];
+      MeshCacheEntry &entry = entries[i];
+      entry = MeshCacheEntry();
+      entry.constants = mesh.material.constants;
+      entry.node = mesh.node;
+      entry.textureOffset = offset;
+      entry.textureCount = static_cast<uint32_t>(mesh.textures.size());
+      for (const Texture &texture : mesh.textures)
+        offset += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+      entry.vertexOffset = offset = align(offset);
+      entry.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+      offset += mesh.vertices.size() * sizeof(Vertex);
+      entry.indexOffset = offset = align(offset);
+      entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+      offset += mesh.indices.size() * sizeof(unsigned int);
+      entry.lodCount = min(mesh.LodCount(), MESH_CACHE_MAX_LODS);
+      entry.lodIndexCount[0] = entry.indexCount;
+      for (uint32_t l = 1; l < entry.lodCount; l++)
+      {
+        entry.lodIndexCount[l] = static_cast<uint32_t>(mesh.lods[l - 1].indices.size());
+        entry.lodError[l] = mesh.lodErrors[l];
+        offset += entry.lodIndexCount[l] * sizeof(unsigned int);
+      }
+      offset = align(offset);
+    }
+
+    // write to a temporary file first so a crash never leaves a truncated cache behind
+    string tempPath = cachePath + ".tmp";
+    ofstream out(tempPath, ios::binary | ios::trunc);
+    if (!out)
+      return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+    pad(out, nodeTableOffset(header.meshCount));
+    out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(MeshCacheNode));
+    for (const string &name : nodes.names)
+      out.write(name.data(), name.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+      const Mesh &mesh = meshes[i];
+      pad(out, entries[i].textureOffset);
+      for (const Texture &texture : mesh.textures)
+      {
+        uint32_t lengths[2] = {static_cast<uint32_t>(texture.type.size()), static_cast<uint32_t>(texture.path.size())};
+        out.write(reinterpret_cast<const char *>(lengths), sizeof(lengths));
+        out.write(texture.type.data(), texture.type.size());
+        out.write(texture.path.data(), texture.path.size());
+      }
+      pad(out, entries[i].vertexOffset);
+      out.write(reinterpret_cast<const char *>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+      pad(out, entries[i].indexOffset);
+      out.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+      for (uint32_t l = 1; l < entries[i].lodCount; l++)
+        out.write(reinterpret_cast<const char *>(mesh.lods[l - 1].indices.data()), mesh.lods[l - 1].indices.size() * sizeof(unsigned int));
+    }
+    out.close();
+    if (!out || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+      remove(tempPath.c_str());
+      return false;
+    }
+    return true;
+  }
+
+private:
+  MappedFile file;
+
+  static uint64_t align(uint64_t offset)
+  {
+    return (offset + 15) & ~uint64_t(15);
+  }
+
+  static uint64_t nodeTableOffset(uint32_t meshCount)
+  {
+    return align(sizeof(MeshCacheHeader) + uint64_t(meshCount) * sizeof(MeshCacheEntry));
+  }
+
+  static void pad(ofstream &out, uint64_t offset)
+  {
+    static const char zeros[16] = {};
+    uint64_t position = static_cast<uint64_t>(out.tellp());
+    if (offset > position)
+      out.write(zeros, offset - position);
+  }
+
+  bool invalid(const string &cachePath)
+  {
+    cout << "WARNING::MESH_CACHE:: corrupt cache file ignored: " << cachePath << endl;
+    meshes.clear();
+    nodes.Clear();
+    file.close();
+    return false;
+  }
+};
+
+#endif
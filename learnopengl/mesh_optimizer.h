@@ -0,0 +1,586 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Index and vertex reordering for indexed triangle lists, run at import time:
+ *   OptimizeVertexCache  - Tipsify (Sander et al. 2007) triangle order for post-transform cache reuse
+ *   OptimizeOverdraw     - reorders the Tipsify clusters so outward-facing ones are drawn first
+ *   OptimizeVertexFetch  - renumbers vertices in first-use order so fetches walk memory linearly
+ *   SplitMesh            - cuts meshes into pieces small enough for 16-bit indices
+ *   SimplifyMesh         - quadric error metric edge collapse for LOD index buffers
+ * plus the statistics used to compare against the original order.
+ */
+
+// post-transform cache size assumed by the optimizer and the statistics
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+  float acmr = 0.0f; // transformed vertices per triangle: 3 worst case, ~0.5 ideal
+  float atvr = 0.0f; // transformed vertices per vertex: 1 ideal
+};
+
+struct OverdrawStats
+{
+  float overdraw = 0.0f; // shaded pixels per covered pixel, averaged over 6 axis views: 1 ideal
+};
+
+// simulates a FIFO cache of VERTEX_CACHE_SIZE entries
+inline VertexCacheStats AnalyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount)
+{
+  VertexCacheStats stats;
+  if (indices.empty() || vertexCount == 0)
+    return stats;
+  vector<unsigned int> insertedAt(vertexCount, 0); // 0 = never, otherwise 1 + insertion time
+  unsigned int time = 0, transformed = 0;
+  for (unsigned int index : indices)
+  {
+    if (insertedAt[index] == 0 || time - (insertedAt[index] - 1) >= VERTEX_CACHE_SIZE)
+    {
+      insertedAt[index] = ++time;
+      transformed++;
+    }
+  }
+  stats.acmr = float(transformed) / float(indices.size() / 3);
+  stats.atvr = float(transformed) / float(vertexCount);
+  return stats;
+}
+
+/*
+ * rasterizes the mesh with depth testing from the six axis directions into a small grid and
+ * counts how many pixels pass the depth test relative to how many end up covered
+ */
+inline OverdrawStats AnalyzeOverdraw(const vector<unsigned int> &indices, const vector<Vertex> &vertices)
+{
+  const int grid = 256;
+  OverdrawStats stats;
+  if (indices.empty() || vertices.empty())
+    return stats;
+
+  glm::vec3 minimum = vertices[0].Position, maximum = vertices[0].Position;
+  for (const Vertex &vertex : vertices)
+  {
+    minimum = glm::min(minimum, vertex.Position);
+    maximum = glm::max(maximum, vertex.Position);
+  }
+  float extent = max(max(maximum.x - minimum.x, maximum.y - minimum.y), maximum.z - minimum.z);
+  float scale = extent > 0.0f ? (grid - 1) / extent : 0.0f;
+
+  vector<float> depth(grid * grid);
+  vector<uint8_t> covered(grid * grid);
+  size_t shadedTotal = 0, coveredTotal = 0;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    for (int flip = 0; flip < 2; flip++)
+    {
+      fill(depth.begin(), depth.end(), numeric_limits<float>::max());
+      fill(covered.begin(), covered.end(), 0);
+      for (size_t t = 0; t + 2 < indices.size(); t += 3)
+      {
+        glm::vec3 p[3];
+        for (int k = 0; k < 3; k++)
+        {
+          glm::vec3 v = (vertices[indices[t + k]].Position - minimum) * scale;
+          float z = flip ? -v[axis] : v[axis];
+          p[k] = glm::vec3(v[(axis + 1) % 3], v[(axis + 2) % 3], z);
+        }
+        // back-face cull (counter-clockwise front faces); looking down the other way mirrors the winding
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (flip ? area <= 0.0f : area >= 0.0f)
+          continue;
+
+        int x0 = max(0, int(min(min(p[0].x, p[1].x), p[2].x)));
+        int x1 = min(grid - 1, int(max(max(p[0].x, p[1].x), p[2].x)));
+        int y0 = max(0, int(min(min(p[0].y, p[1].y), p[2].y)));
+        int y1 = min(grid - 1, int(max(max(p[0].y, p[1].y), p[2].y)));
+        for (int y = y0; y <= y1; y++)
+        {
+          for (int x = x0; x <= x1; x++)
+          {
+            // barycentric coordinates of the pixel centre
+            float px = x + 0.5f, py = y + 0.5f;
+            float w0 = (p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x);
+            float w1 = (p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x);
+            float w2 = (p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x);
+            if (w0 * area < 0.0f || w1 * area < 0.0f || w2 * area < 0.0f)
+              continue;
+            float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / area;
+            float &stored = depth[y * grid + x];
+            if (z < stored)
+            {
+              stored = z;
+              shadedTotal++;
+              if (!covered[y * grid + x])
+              {
+                covered[y * grid + x] = 1;
+                coveredTotal++;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  stats.overdraw = coveredTotal > 0 ? float(shadedTotal) / float(coveredTotal) : 0.0f;
+  return stats;
+}
+
+/*
+ * Tipsify: fans around the most recently used vertex that can still be served from the cache,
+ * falling back to a dead-end stack and then a linear scan. clusterStarts (optional) receives
+ * the first triangle of each run that starts after such a fallback; the cache is cold there,
+ * so those runs can be reordered freely without hurting ACMR.
+ */
+inline vector<unsigned int> OptimizeVertexCache(const vector<unsigned int> &indices, size_t vertexCount,
+                                               vector<size_t> *clusterStarts = nullptr)
+{
+  size_t triangleCount = indices.size() / 3;
+  vector<unsigned int> result;
+  result.reserve(triangleCount * 3);
+  if (clusterStarts)
+    clusterStarts->clear();
+  if (triangleCount == 0)
+    return result;
+
+  // vertex -> triangle adjacency
+  vector<unsigned int> live(vertexCount, 0), offsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++)
+    live[indices[i]]++;
+  for (size_t v = 0; v < vertexCount; v++)
+    offsets[v + 1] = offsets[v] + live[v];
+  vector<unsigned int> adjacency(offsets[vertexCount]), next = offsets;
+  for (size_t t = 0; t < triangleCount; t++)
+    for (int k = 0; k < 3; k++)
+      adjacency[next[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+  vector<unsigned int> cacheTime(vertexCount, 0);
+  vector<uint8_t> emitted(triangleCount, 0);
+  vector<unsigned int> deadEnd, candidates;
+  unsigned int time = VERTEX_CACHE_SIZE + 1;
+  size_t cursor = 0;
+  int fanning = indices[0];
+  bool fromFallback = true;
+
+  while (fanning >= 0)
+  {
+    if (fromFallback && clusterStarts)
+      clusterStarts->push_back(result.size() / 3);
+
+    candidates.clear();
+    for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+    {
+      unsigned int t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = 1;
+      for (int k = 0; k < 3; k++)
+      {
+        unsigned int v = indices[t * 3 + k];
+        result.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > VERTEX_CACHE_SIZE)
+          cacheTime[v] = time++;
+      }
+    }
+
+    // prefer the candidate that stays in the cache longest while its remaining fan is emitted
+    int best = -1, bestPriority = -1;
+    for (unsigned int v : candidates)
+    {
+      if (live[v] == 0)
+        continue;
+      int priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= VERTEX_CACHE_SIZE)
+        priority = int(time - cacheTime[v]);
+      if (priority > bestPriority)
+      {
+        best = v;
+        bestPriority = priority;
+      }
+    }
+
+    fromFallback = best < 0;
+    if (best < 0)
+    {
+      while (!deadEnd.empty() && best < 0)
+      {
+        unsigned int v = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[v] > 0)
+          best = v;
+      }
+      while (best < 0 && cursor < vertexCount)
+      {
+        if (live[cursor] > 0)
+          best = int(cursor);
+        cursor++;
+      }
+    }
+    fanning = best;
+  }
+  return result;
+}
+
+/*
+ * Sorts the clusters of a cache-optimized index buffer so that triangles facing away from the
+ * mesh centre come first; they tend to occlude the rest. clusterStarts comes from
+ * OptimizeVertexCache, so the cache behaviour inside every cluster is unchanged.
+ */
+inline vector<unsigned int> OptimizeOverdraw(const vector<unsigned int> &indices, const vector<Vertex> &vertices,
+                                            const vector<size_t> &clusterStarts)
+{
+  size_t triangleCount = indices.size() / 3;
+  if (clusterStarts.size() < 2)
+    return indices;
+
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  struct Cluster
+  {
+    size_t first, end;
+    float sortKey;
+  };
+  vector<Cluster> clusters;
+  vector<glm::vec3> centroids, normals;
+  for (size_t c = 0; c < clusterStarts.size(); c++)
+  {
+    size_t first = clusterStarts[c];
+    size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (size_t t = first; t < end; t++)
+    {
+      const glm::vec3 &a = vertices[indices[t * 3]].Position, &b = vertices[indices[t * 3 + 1]].Position,
+                      &d = vertices[indices[t * 3 + 2]].Position;
+      glm::vec3 cross = glm::cross(b - a, d - a);
+      float triangleArea = glm::length(cross);
+      centroid += (a + b + d) * (triangleArea / 3.0f);
+      normal += cross;
+      area += triangleArea;
+    }
+    meshCentroid += centroid;
+    meshArea += area;
+    centroids.push_back(area > 0.0f ? centroid / area : centroid);
+    float length = glm::length(normal);
+    normals.push_back(length > 0.0f ? normal / length : normal);
+    clusters.push_back(Cluster{first, end, 0.0f});
+  }
+  if (meshArea > 0.0f)
+    meshCentroid /= meshArea;
+  for (size_t c = 0; c < clusters.size(); c++)
+    clusters[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+  stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+  vector<unsigned int> result;
+  result.reserve(indices.size());
+  for (const Cluster &cluster : clusters)
+    result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.end * 3);
+  return result;
+}
+
+// renumbers vertices in order of first use and drops unreferenced ones; returns the new vertex count
+inline size_t OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+  const unsigned int unused = numeric_limits<unsigned int>::max();
+  vector<unsigned int> remap(vertices.size(), unused);
+  vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+  for (unsigned int &index : indices)
+  {
+    if (remap[index] == unused)
+    {
+      remap[index] = static_cast<unsigned int>(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(reordered);
+  return vertices.size();
+}
+
+// runs all three passes in order
+inline void OptimizeMesh(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+  vector<size_t> clusterStarts;
+  indices = OptimizeVertexCache(indices, vertices.size(), &clusterStarts);
+  indices = OptimizeOverdraw(indices, vertices, clusterStarts);
+  OptimizeVertexFetch(vertices, indices);
+}
+
+// one piece of a split mesh, indices relative to its own vertices
+struct MeshChunk
+{
+  vector<Vertex> vertices;
+  vector<unsigned int> indices;
+};
+
+/*
+ * splits a mesh into chunks that reference at most maxVertices vertices each, taking triangles
+ * in their current order so an optimized mesh keeps its locality; vertices on a cut are copied
+ * into both chunks. Meshes that already fit come back as a single chunk.
+ */
+inline vector<MeshChunk> SplitMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, size_t maxVertices)
+{
+  const unsigned int unused = numeric_limits<unsigned int>::max();
+  vector<unsigned int> remap(vertices.size(), unused);
+  vector<unsigned int> sources; // source vertex of each vertex in the current chunk
+  vector<MeshChunk> chunks(1);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    size_t added = 0;
+    for (size_t k = 0; k < 3; k++)
+      added += remap[indices[i + k]] == unused && (k < 1 || indices[i + k] != indices[i]) &&
+               (k < 2 || indices[i + k] != indices[i + 1]);
+    if (sources.size() + added > maxVertices)
+    {
+      for (unsigned int source : sources)
+        remap[source] = unused;
+      sources.clear();
+      chunks.emplace_back();
+    }
+
+    MeshChunk &chunk = chunks.back();
+    for (size_t k = 0; k < 3; k++)
+    {
+      unsigned int index = indices[i + k];
+      if (remap[index] == unused)
+      {
+        remap[index] = static_cast<unsigned int>(chunk.vertices.size());
+        chunk.vertices.push_back(vertices[index]);
+        sources.push_back(index);
+      }
+      chunk.indices.push_back(remap[index]);
+    }
+  }
+  return chunks;
+}
+
+// symmetric 4x4 error quadric (Garland & Heckbert 1997): sum of squared distances to a set of planes
+struct Quadric
+{
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+
+  static Quadric FromPlane(const glm::dvec3 &normal, double distance)
+  {
+    Quadric q;
+    q.a00 = normal.x * normal.x, q.a01 = normal.x * normal.y, q.a02 = normal.x * normal.z, q.a03 = normal.x * distance;
+    q.a11 = normal.y * normal.y, q.a12 = normal.y * normal.z, q.a13 = normal.y * distance;
+    q.a22 = normal.z * normal.z, q.a23 = normal.z * distance;
+    q.a33 = distance * distance;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &q)
+  {
+    a00 += q.a00, a01 += q.a01, a02 += q.a02, a03 += q.a03, a11 += q.a11;
+    a12 += q.a12, a13 += q.a13, a22 += q.a22, a23 += q.a23, a33 += q.a33;
+    return *this;
+  }
+
+  double Error(const glm::vec3 &p) const
+  {
+    double x = p.x, y = p.y, z = p.z;
+    double error = a00 * x * x + a11 * y * y + a22 * z * z + a33 +
+                   2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+    return max(error, 0.0);
+  }
+};
+
+/*
+ * Simplifies a triangle list towards targetIndexCount by collapsing vertices onto neighbouring
+ * vertices (half-edge collapse), so the result indexes the same vertex buffer. Each pass sorts
+ * all candidate collapses by quadric error and applies the cheapest independent ones, skipping
+ * any that would flip a triangle. Vertices on UV/normal seams and on open borders stay fixed,
+ * which keeps textures and silhouettes intact at the cost of stopping early on very cut-up
+ * meshes. Stops at the target, when nothing is left to collapse, or when the next collapse
+ * would exceed maxError (object-space distance); resultError receives the largest error used.
+ */
+inline vector<unsigned int> SimplifyMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, size_t targetIndexCount,
+                                        float maxError, float *resultError = nullptr)
+{
+  size_t vertexCount = vertices.size();
+  vector<unsigned int> result = indices;
+  if (resultError)
+    *resultError = 0.0f;
+  if (vertexCount == 0 || indices.size() <= targetIndexCount)
+    return result;
+
+  // vertices sharing a position form one class; the class keeps the quadric and topology
+  vector<unsigned int> positionClass(vertexCount), classSize(vertexCount, 0);
+  {
+    struct PositionHash
+    {
+      size_t operator()(const glm::vec3 &p) const
+      {
+        uint32_t bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+      }
+    };
+    unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+    firstAt.reserve(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++)
+      positionClass[v] = firstAt.emplace(vertices[v].Position, v).first->second;
+    for (unsigned int v = 0; v < vertexCount; v++)
+      classSize[positionClass[v]]++;
+  }
+
+  // seams (several vertices per position) and open border edges are locked
+  vector<uint8_t> locked(vertexCount, 0);
+  {
+    unordered_map<uint64_t, unsigned int> edgeUses;
+    edgeUses.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+      for (size_t k = 0; k < 3; k++)
+      {
+        uint64_t a = positionClass[indices[i + k]], b = positionClass[indices[i + (k + 1) % 3]];
+        edgeUses[min(a, b) << 32 | max(a, b)]++;
+      }
+    for (const auto &edge : edgeUses)
+      if (edge.second == 1)
+        locked[edge.first >> 32] = locked[edge.first & 0xffffffffu] = 1;
+    for (unsigned int v = 0; v < vertexCount; v++)
+      if (classSize[positionClass[v]] > 1)
+        locked[positionClass[v]] = 1;
+  }
+
+  vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    glm::dvec3 p0 = vertices[indices[i]].Position, p1 = vertices[indices[i + 1]].Position, p2 = vertices[indices[i + 2]].Position;
+    glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+    double length = glm::length(normal);
+    if (length == 0.0)
+      continue;
+    normal /= length;
+    Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, p0));
+    for (size_t k = 0; k < 3; k++)
+      quadrics[positionClass[indices[i + k]]] += plane;
+  }
+
+  struct Collapse
+  {
+    unsigned int from, to;
+    double error;
+  };
+  double maxErrorSquared = double(maxError) * maxError, largestError = 0.0;
+  size_t targetTriangles = targetIndexCount / 3;
+  vector<unsigned int> remap(vertexCount), offsets(vertexCount + 1), adjacency;
+  vector<uint8_t> touched(vertexCount);
+  vector<Collapse> collapses;
+
+  while (result.size() / 3 > targetTriangles)
+  {
+    // vertex -> triangle adjacency of the current result
+    fill(offsets.begin(), offsets.end(), 0);
+    for (unsigned int index : result)
+      offsets[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+      offsets[v + 1] += offsets[v];
+    adjacency.resize(result.size());
+    vector<unsigned int> fillAt(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < result.size(); i++)
+      adjacency[fillAt[result[i]]++] = static_cast<unsigned int>(i / 3);
+
+    collapses.clear();
+    for (size_t i = 0; i + 2 < result.size(); i += 3)
+      for (size_t k = 0; k < 3; k++)
+      {
+        unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+        for (int direction = 0; direction < 2; direction++, swap(a, b))
+        {
+          if (locked[positionClass[a]])
+            continue;
+          Quadric q = quadrics[positionClass[a]];
+          q += quadrics[positionClass[b]];
+          collapses.push_back(Collapse{a, b, q.Error(vertices[b].Position)});
+        }
+      }
+    sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+    for (unsigned int v = 0; v < vertexCount; v++)
+      remap[v] = v;
+    fill(touched.begin(), touched.end(), 0);
+    size_t triangles = result.size() / 3, applied = 0;
+    for (const Collapse &collapse : collapses)
+    {
+      if (triangles <= targetTriangles || collapse.error > maxErrorSquared)
+        break;
+      unsigned int a = collapse.from, b = collapse.to;
+      if (touched[a] || touched[b])
+        continue;
+
+      // reject collapses that flip or squash a remaining triangle around a
+      bool flips = false;
+      size_t removed = 0;
+      glm::vec3 target = vertices[b].Position;
+      for (unsigned int t = offsets[a]; t < offsets[a + 1] && !flips; t++)
+      {
+        const unsigned int *triangle = &result[adjacency[t] * 3];
+        if (triangle[0] == b || triangle[1] == b || triangle[2] == b)
+        {
+          removed++;
+          continue;
+        }
+        glm::vec3 p[3], q[3];
+        for (int k = 0; k < 3; k++)
+        {
+          p[k] = vertices[triangle[k]].Position;
+          q[k] = triangle[k] == a ? target : p[k];
+        }
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]), after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+      }
+      if (flips)
+        continue;
+
+      remap[a] = b;
+      quadrics[positionClass[b]] += quadrics[positionClass[a]];
+      for (unsigned int t = offsets[a]; t < offsets[a + 1]; t++)
+        for (int k = 0; k < 3; k++)
+          touched[result[adjacency[t] * 3 + k]] = 1;
+      triangles -= removed;
+      largestError = max(largestError, collapse.error);
+      applied++;
+    }
+    if (applied == 0)
+      break;
+
+    // apply the collapses and drop the triangles that became degenerate
+    size_t write = 0;
+    for (size_t i = 0; i + 2 < result.size(); i += 3)
+    {
+      unsigned int i0 = remap[result[i]], i1 = remap[result[i + 1]], i2 = remap[result[i + 2]];
+      unsigned int c0 = positionClass[i0], c1 = positionClass[i1], c2 = positionClass[i2];
+      if (c0 == c1 || c1 == c2 || c0 == c2)
+        continue;
+      result[write++] = i0;
+      result[write++] = i1;
+      result[write++] = i2;
+    }
+    result.resize(write);
+  }
+
+  if (resultError)
+    *resultError = float(sqrt(largestError));
+  return result;
+}
+
+#endif
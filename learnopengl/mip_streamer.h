@@ -0,0 +1,532 @@
+#ifndef MIP_STREAMER_H
+#define MIP_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "bindless.h"
+#include "bounds.h"
+#include "lod.h"
+#include "mesh.h"
+#include "mip_builder.h"
+#include "profiler.h"
+#include "texture_cache.h"
+#include "texture_compression.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// stb_image.h must be included before this header (texture_loader.h does so)
+
+/*
+ * Demand-driven mip streaming for model textures. Load uploads only the mip tail (levels no
+ * larger than ResidentTailSize) and clamps GL_TEXTURE_BASE_LEVEL to it. Each frame the draws
+ * report the finest level every texture needs (Request, from the mesh's projected size and UV
+ * density); Update reads the missing levels on the WorkerPool, from <image>.dds when compressed
+ * or by decoding and filtering the image again, uploads them and lowers the base level.
+ * Uncompressed images have to be decoded and filtered down to the tail at Load anyway, so the
+ * levels above the tail are kept in system memory, within DecodedBudgetBytes, and hand their first
+ * read over without decoding again. Past that budget the least recently drawn (then loaded)
+ * textures drop theirs and read on demand like the .dds path; a texture evicted for BudgetBytes
+ * drops what it still keeps. Only the .dds path avoids the full decode at Load.
+ *
+ * Resident levels stay within BudgetBytes. To make room, levels finer than their texture needs
+ * are evicted least recently used first; textures not drawn in the last Update count as needing
+ * only their tail. When that is not enough the request is served a coarser level.
+ *
+ * Levels are defined one at a time rather than with glTexStorage2D, whose immutable storage
+ * would allocate the whole chain up front; evicted levels are redefined as 0x0 so the driver
+ * can free them. GL thread only.
+ */
+class MipStreamer
+{
+public:
+  bool Enabled = false;             // route TextureFromFile through Load
+  size_t BudgetBytes = 64 * 1048576; // resident levels of every streamed texture, tails included
+  int ResidentTailSize = 64;        // levels this size or smaller load up front and are never evicted
+  size_t DecodedBudgetBytes = 32 * 1048576; // system memory for levels kept from Load, see Entry::decoded; 0 keeps none
+  unsigned int MaxInFlight = 4;     // textures being read on the WorkerPool at once
+
+  // counters since startup
+  unsigned int levelsStreamed = 0;
+  unsigned int levelsEvicted = 0;
+  size_t bytesStreamed = 0;
+  size_t decodedBytes = 0;       // levels built at Load and not uploaded yet, see Entry::decoded
+  unsigned int budgetMisses = 0; // reads started coarser than requested for lack of budget
+
+  static MipStreamer &Instance()
+  {
+    static MipStreamer streamer;
+    return streamer;
+  }
+
+  /*
+   * creates the texture with only its mip tail resident; bytes is the size of the full chain.
+   * Returns 0 when the image cannot be read. Mips come from the .dds with TextureCompression
+   * enabled (and writing its cache), from the MipBuilder otherwise.
+   */
+  unsigned int Load(const string &path, bool gamma, size_t &bytes)
+  {
+    PROFILE_SCOPE("MipStreamer::Load");
+    Entry entry;
+    entry.path = path;
+    entry.gamma = gamma;
+    MipOptions options;
+    options.srgb = gamma;
+
+    CompressedImage image;
+    MipChain chain;
+    TextureCompression &compression = TextureCompression::Instance();
+    entry.compressed = compression.Enabled && compression.WriteCache &&
+                       compression.LoadImage(path, options, image, entry.sourceHash, entry.cacheFlags);
+    if (entry.compressed)
+    {
+      entry.blockFormat = image.format;
+      entry.format = BlockGLFormat(image.format);
+      entry.width = image.width;
+      entry.height = image.height;
+      entry.levelCount = int(image.levels.size());
+    }
+    else
+    {
+      unsigned char *pixels = stbi_load(path.c_str(), &entry.width, &entry.height, &entry.components, 0);
+      if (!pixels)
+        return 0;
+      chain = MipBuilder::Instance().Build(pixels, entry.width, entry.height, entry.components, options);
+      stbi_image_free(pixels);
+      entry.format = TextureFormat(entry.components);
+      entry.levelCount = int(chain.levels.size());
+    }
+
+    entry.tailTop = entry.levelCount - 1;
+    while (entry.tailTop > 0 && max(levelWidth(entry, entry.tailTop - 1), levelHeight(entry, entry.tailTop - 1)) <= ResidentTailSize)
+      entry.tailTop--;
+    entry.residentTop = entry.wantedTop = entry.frameTop = entry.tailTop;
+    entry.serial = ++lastSerial;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    for (int level = entry.tailTop; level < entry.levelCount; level++)
+      uploadLevel(entry, level, entry.compressed ? image.levels[level].data() : chain.levels[level].data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.tailTop);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    residentBytes += rangeBytes(entry, entry.tailTop, entry.levelCount);
+    bytes = rangeBytes(entry, 0, entry.levelCount);
+    if (!entry.compressed)
+    {
+      chain.levels.resize(entry.tailTop);
+      entry.decoded = std::move(chain.levels);
+      decodedBytes += rangeBytes(entry, 0, entry.tailTop);
+    }
+    entries[textureID] = std::move(entry);
+    trimDecoded();
+    return textureID;
+  }
+
+  /*
+   * notes that a texture is drawn with uvPerPixel texture coordinate units per screen pixel;
+   * the finest of the frame's requests is streamed in by the next Update. Ignores textures
+   * that were not loaded through Load.
+   */
+  void Request(unsigned int id, float uvPerPixel)
+  {
+    auto found = entries.find(id);
+    if (found == entries.end())
+      return;
+    Entry &entry = found->second;
+    // texels per pixel at level 0; each level halves it, and under one texel level 0 is needed
+    float texels = uvPerPixel * max(entry.width, entry.height);
+    int level = entry.tailTop;
+    if (texels > 0.0f)
+      level = clamp(int(floor(log2(texels))), 0, entry.tailTop);
+    entry.frameTop = min(entry.frameTop, level);
+    entry.lastUsed = frame;
+  }
+
+  // applies finished reads, evicts to fit the budget and starts new reads; once per frame
+  void Update()
+  {
+    PROFILE_SCOPE("MipStreamer::Update");
+    collect();
+    for (auto &item : entries)
+    {
+      Entry &entry = item.second;
+      entry.wantedTop = entry.lastUsed == frame ? entry.frameTop : entry.tailTop;
+      entry.frameTop = entry.tailTop;
+    }
+    if (residentBytes > BudgetBytes)
+      evict(residentBytes - BudgetBytes, 0);
+
+    // most recently drawn first, then the ones furthest from what they need
+    vector<pair<unsigned int, Entry *>> needed;
+    for (auto &item : entries)
+      if (!item.second.loading && !item.second.failed && item.second.wantedTop < item.second.residentTop)
+        needed.emplace_back(item.first, &item.second);
+    sort(needed.begin(), needed.end(), [](const pair<unsigned int, Entry *> &a, const pair<unsigned int, Entry *> &b)
+    {
+      if (a.second->lastUsed != b.second->lastUsed)
+        return a.second->lastUsed > b.second->lastUsed;
+      return a.second->residentTop - a.second->wantedTop > b.second->residentTop - b.second->wantedTop;
+    });
+
+    for (auto &item : needed)
+    {
+      if (inFlight >= MaxInFlight)
+        break;
+      Entry &entry = *item.second;
+      size_t total = residentBytes + reservedBytes + rangeBytes(entry, entry.wantedTop, entry.residentTop);
+      if (total > BudgetBytes)
+        evict(total - BudgetBytes, item.first);
+      int top = entry.wantedTop;
+      while (top < entry.residentTop && residentBytes + reservedBytes + rangeBytes(entry, top, entry.residentTop) > BudgetBytes)
+        top++;
+      if (top != entry.wantedTop)
+        budgetMisses++;
+      if (top < entry.residentTop)
+        start(item.first, entry, top);
+    }
+    frame++;
+  }
+
+  // blocks until every read in flight is uploaded
+  void Flush()
+  {
+    while (inFlight > 0)
+    {
+      this_thread::yield();
+      collect();
+    }
+  }
+
+  // drops a texture's state; the TextureCache calls it before deleting one
+  void Forget(unsigned int id)
+  {
+    auto found = entries.find(id);
+    if (found == entries.end())
+      return;
+    residentBytes -= rangeBytes(found->second, found->second.residentTop, found->second.levelCount);
+    dropDecoded(found->second);
+    entries.erase(found);
+  }
+
+  size_t ResidentBytes() const
+  {
+    return residentBytes;
+  }
+
+  // finest resident level of a streamed texture, -1 for others
+  int ResidentLevel(unsigned int id) const
+  {
+    auto found = entries.find(id);
+    return found == entries.end() ? -1 : found->second.residentTop;
+  }
+
+  void PrintStats() const
+  {
+    printf("MIP_STREAMER:: %zu textures, resident %.1f MB / budget %.1f MB (%.1f MB reading, %.1f MB / %.1f MB decoded), %u levels "
+           "streamed (%.1f MB), %u evicted, %u budget misses\n",
+           entries.size(), residentBytes / 1048576.0, BudgetBytes / 1048576.0, reservedBytes / 1048576.0, decodedBytes / 1048576.0,
+           DecodedBudgetBytes / 1048576.0, levelsStreamed, bytesStreamed / 1048576.0, levelsEvicted, budgetMisses);
+  }
+
+private:
+  struct Entry
+  {
+    string path;
+    bool gamma = false;
+    bool compressed = false;
+    BlockFormat blockFormat = BlockFormat::BC1;
+    uint64_t sourceHash = 0; // of the .dds, when compressed
+    uint32_t cacheFlags = 0;
+    GLenum format = GL_RGBA;
+    int width = 0, height = 0, components = 0;
+    int levelCount = 0;
+    int tailTop = 0;     // first level of the tail, always resident
+    int residentTop = 0; // finest resident level, the texture's GL_TEXTURE_BASE_LEVEL
+    int wantedTop = 0;   // finest level the last frame's draws needed
+    int frameTop = 0;    // finest level requested since the last Update
+    uint64_t lastUsed = 0;
+    uint64_t serial = 0; // tells a reused texture id from the one a read was started for
+    bool loading = false;
+    bool failed = false;
+    // uncompressed levels above the tail, built at Load; a level is emptied once it is handed to a read
+    vector<vector<unsigned char>> decoded;
+  };
+
+  struct Job
+  {
+    unsigned int id = 0;
+    uint64_t serial = 0;
+    string path;
+    bool gamma = false;
+    bool compressed = false;
+    uint64_t sourceHash = 0;
+    uint32_t cacheFlags = 0;
+    int width = 0, height = 0, components = 0;
+    int first = 0, end = 0; // levels [first, end) are read
+    size_t bytes = 0;       // their size, reserved from the budget meanwhile
+    vector<vector<unsigned char>> levels;
+  };
+
+  unordered_map<unsigned int, Entry> entries;
+  size_t residentBytes = 0;
+  size_t reservedBytes = 0;
+  unsigned int inFlight = 0;
+  uint64_t frame = 1;
+  uint64_t lastSerial = 0;
+  mutex finishedMutex;
+  deque<shared_ptr<Job>> finished;
+
+  MipStreamer()
+  {
+    TextureCache::Instance().OnDelete.push_back([this](unsigned int id) { Forget(id); });
+    // streamed textures keep changing their level range
+    BindlessTextures::Instance().Busy.push_back([this](unsigned int id) { return ResidentLevel(id) != -1; });
+  }
+
+  static int levelWidth(const Entry &entry, int level)
+  {
+    return max(1, entry.width >> level);
+  }
+
+  static int levelHeight(const Entry &entry, int level)
+  {
+    return max(1, entry.height >> level);
+  }
+
+  static size_t levelBytes(const Entry &entry, int level)
+  {
+    if (entry.compressed)
+      return dds_detail::levelBytes(entry.blockFormat, levelWidth(entry, level), levelHeight(entry, level));
+    return size_t(levelWidth(entry, level)) * levelHeight(entry, level) * entry.components;
+  }
+
+  static size_t rangeBytes(const Entry &entry, int first, int end)
+  {
+    size_t bytes = 0;
+    for (int level = first; level < end; level++)
+      bytes += levelBytes(entry, level);
+    return bytes;
+  }
+
+  // defines one level of the bound texture; a null data with 0x0 dimensions frees it
+  static void uploadLevel(const Entry &entry, int level, const unsigned char *data, bool evicted = false)
+  {
+    int width = evicted ? 0 : levelWidth(entry, level), height = evicted ? 0 : levelHeight(entry, level);
+    if (entry.compressed)
+    {
+      glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.format, width, height, 0, evicted ? 0 : GLsizei(levelBytes(entry, level)), data);
+      return;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, level, entry.format, width, height, 0, entry.format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  /*
+   * frees at least bytes by evicting levels finer than their texture needs, finest level of the
+   * least recently drawn texture first; keep is the texture the room is made for
+   */
+  void evict(size_t bytes, unsigned int keep)
+  {
+    vector<pair<unsigned int, Entry *>> candidates;
+    for (auto &item : entries)
+      if (item.first != keep && !item.second.loading && item.second.residentTop < item.second.wantedTop)
+        candidates.emplace_back(item.first, &item.second);
+    sort(candidates.begin(), candidates.end(), [](const pair<unsigned int, Entry *> &a, const pair<unsigned int, Entry *> &b)
+    {
+      return a.second->lastUsed < b.second->lastUsed;
+    });
+
+    size_t freed = 0;
+    for (auto &item : candidates)
+    {
+      if (freed >= bytes)
+        break;
+      Entry &entry = *item.second;
+      dropDecoded(entry);
+      glBindTexture(GL_TEXTURE_2D, item.first);
+      int top = entry.residentTop;
+      while (freed < bytes && top < entry.wantedTop)
+        freed += levelBytes(entry, top++);
+      // raise the base level before the levels below it disappear, so the texture stays complete
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, top);
+      for (int level = entry.residentTop; level < top; level++)
+        uploadLevel(entry, level, nullptr, true);
+      levelsEvicted += unsigned(top - entry.residentTop);
+      residentBytes -= rangeBytes(entry, entry.residentTop, top);
+      entry.residentTop = top;
+    }
+  }
+
+  void start(unsigned int id, Entry &entry, int top)
+  {
+    shared_ptr<Job> job = make_shared<Job>();
+    job->id = id;
+    job->serial = entry.serial;
+    job->path = entry.path;
+    job->gamma = entry.gamma;
+    job->compressed = entry.compressed;
+    job->sourceHash = entry.sourceHash;
+    job->cacheFlags = entry.cacheFlags;
+    job->width = entry.width;
+    job->height = entry.height;
+    job->components = entry.components;
+    job->first = top;
+    job->end = entry.residentTop;
+    job->bytes = rangeBytes(entry, top, entry.residentTop);
+    reservedBytes += job->bytes;
+    entry.loading = true;
+    inFlight++;
+
+    // levels still kept from Load go straight to the next collect
+    bool decoded = int(entry.decoded.size()) >= job->end;
+    for (int level = job->first; decoded && level < job->end; level++)
+      decoded = !entry.decoded[level].empty();
+    if (decoded)
+    {
+      for (int level = job->first; level < job->end; level++)
+        job->levels.push_back(std::move(entry.decoded[level]));
+      decodedBytes -= job->bytes;
+      lock_guard<mutex> lock(finishedMutex);
+      finished.push_back(job);
+      return;
+    }
+
+    WorkerPool().Enqueue([this, job]
+    {
+      read(*job);
+      lock_guard<mutex> lock(finishedMutex);
+      finished.push_back(job);
+    });
+  }
+
+  // worker side; leaves job.levels empty when the source no longer matches the texture
+  static void read(Job &job)
+  {
+    PROFILE_SCOPE("MipStreamer::read");
+    vector<vector<unsigned char>> levels;
+    if (job.compressed)
+    {
+      CompressedImage image;
+      if (!ReadDDS(job.path + ".dds", job.sourceHash, job.cacheFlags, image, uint32_t(job.first)) || image.width != job.width ||
+          image.height != job.height || int(image.levels.size()) < job.end)
+        return;
+      levels = std::move(image.levels);
+    }
+    else
+    {
+      int width, height, components;
+      unsigned char *pixels = stbi_load(job.path.c_str(), &width, &height, &components, 0);
+      if (!pixels)
+        return;
+      if (width == job.width && height == job.height && components == job.components)
+      {
+        MipOptions options;
+        options.srgb = job.gamma;
+        options.parallel = false; // already on a worker
+        levels = MipBuilder::Instance().Build(pixels, width, height, components, options).levels;
+      }
+      stbi_image_free(pixels);
+      if (int(levels.size()) < job.end)
+        return;
+    }
+    for (int level = job.first; level < job.end; level++)
+      job.levels.push_back(std::move(levels[level]));
+  }
+
+  // drops kept levels until decodedBytes fits DecodedBudgetBytes, least recently drawn first, then oldest loaded
+  void trimDecoded()
+  {
+    if (decodedBytes <= DecodedBudgetBytes)
+      return;
+    vector<Entry *> holders;
+    for (auto &item : entries)
+      if (!item.second.decoded.empty())
+        holders.push_back(&item.second);
+    sort(holders.begin(), holders.end(), [](const Entry *a, const Entry *b)
+    {
+      return a->lastUsed != b->lastUsed ? a->lastUsed < b->lastUsed : a->serial < b->serial;
+    });
+    for (Entry *entry : holders)
+    {
+      if (decodedBytes <= DecodedBudgetBytes)
+        break;
+      dropDecoded(*entry);
+    }
+  }
+
+  void dropDecoded(Entry &entry)
+  {
+    for (int level = 0; level < int(entry.decoded.size()); level++)
+      if (!entry.decoded[level].empty())
+        decodedBytes -= levelBytes(entry, level);
+    entry.decoded = vector<vector<unsigned char>>();
+  }
+
+  // uploads the levels of finished reads and lowers their textures' base level
+  void collect()
+  {
+    deque<shared_ptr<Job>> done;
+    {
+      lock_guard<mutex> lock(finishedMutex);
+      done.swap(finished);
+    }
+    for (const shared_ptr<Job> &job : done)
+    {
+      inFlight--;
+      reservedBytes -= job->bytes;
+      auto found = entries.find(job->id);
+      if (found == entries.end() || found->second.serial != job->serial)
+        continue;
+      Entry &entry = found->second;
+      entry.loading = false;
+      if (job->levels.empty())
+      {
+        cout << "WARNING::MIP_STREAMER:: cannot read mips of " << entry.path << ", keeping level " << entry.residentTop << endl;
+        entry.failed = true;
+        continue;
+      }
+      glBindTexture(GL_TEXTURE_2D, job->id);
+      for (int level = job->first; level < job->end; level++)
+        uploadLevel(entry, level, job->levels[level - job->first].data());
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job->first);
+      entry.residentTop = job->first;
+      residentBytes += job->bytes;
+      bytesStreamed += job->bytes;
+      levelsStreamed += unsigned(job->end - job->first);
+    }
+  }
+};
+
+// reports the level each of a mesh's textures needs when drawn with the given world-space bounds
+inline void RequestMeshMips(const Mesh &mesh, const BoundingSphere &worldSphere, const LodView &view)
+{
+  if (mesh.sphere.radius <= 0.0f)
+    return;
+  // world units per object unit, and from there texture coordinates per pixel
+  float scale = worldSphere.radius / mesh.sphere.radius;
+  float uvPerPixel = mesh.uvDensity / scale * view.UnitsPerPixel(worldSphere);
+  for (const Texture &texture : mesh.textures)
+    MipStreamer::Instance().Request(texture.id, uvPerPixel);
+}
+
+#endif
@@ -5,88 +5,627 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "bounds.h"
+#include "frustum.h"
+#include "lod.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mip_streamer.h"
+#include "profiler.h"
+#include "scene_graph.h"
 #include "shader.h"
+#include "texture_array.h"
+#include "texture_cache.h"
+#include "texture_compression.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+#include <chrono>
+#include <memory>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// stream: load through the MipStreamer when it is Enabled; false uploads the whole chain
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, bool stream = true);
+unsigned int TextureFromFileUncached(const string &filename, size_t &bytes, bool gamma = false, bool stream = true);
+
+// Assimp post-processing applied to every model; part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals |
+                                       aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// mesh cache option bits: indices and vertices were reordered by OptimizeMesh / split by SplitMesh;
+// the LOD count goes above MODEL_CACHE_LOD_SHIFT
+const uint32_t MODEL_CACHE_OPTIMIZED = 1;
+const uint32_t MODEL_CACHE_SPLIT = 2;
+const uint32_t MODEL_CACHE_LOD_SHIFT = 8;
+
+// vertex cache and overdraw figures of one mesh before and after OptimizeMesh
+struct MeshOptimizerStats
+{
+  size_t triangles = 0;
+  VertexCacheStats rawCache, cache;
+  OverdrawStats rawOverdraw, overdraw;
+};
+
+// CPU-side result of converting one aiMesh; textures only carry type and path until resolved on the GL thread
+struct MeshData
+{
+  vector<Vertex> vertices;
+  vector<unsigned int> indices;
+  vector<Texture> textures;
+  MaterialConstants constants;
+  AABB bounds;
+  BoundingSphere sphere;
+  unsigned int node = 0;
+  MeshOptimizerStats stats; // only filled with Model::ReportLoadStats
+  vector<vector<unsigned int>> lodIndices; // LOD 1, 2, ...
+  vector<float> lodErrors;                 // matching errors relative to sphere.radius
+};
+
+inline void ComputeBounds(MeshData &data)
+{
+  ComputeBounds(data.vertices, [](const Vertex &vertex) { return vertex.Position; }, data.bounds, data.sphere);
+}
+
+// texture coordinate units per object-space unit, sqrt(UV area / surface area) over the triangles
+inline float ComputeUvDensity(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+{
+  double uvArea = 0.0, area = 0.0;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    const Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+    glm::vec2 du = b.TexCoords - a.TexCoords, dv = c.TexCoords - a.TexCoords;
+    uvArea += fabs(du.x * dv.y - du.y * dv.x);
+    area += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+  }
+  return area > 0.0 ? float(sqrt(uvArea / area)) : 0.0f;
+}
 
 class Model
 {
 public:
+  // load options shared by every Model instance
+  static inline bool UseMeshCache = true;     // read/write <path>.meshcache instead of always running Assimp
+  static inline bool ReportLoadStats = false;  // print cold (Assimp) or warm (cache) load time and vertex memory per model
+  static inline bool ParallelImport = true;    // convert aiMeshes on the WorkerPool instead of the calling thread
+  static inline bool ShareSceneGeometry = true; // sub-allocate from GeometryArenas::Scene() instead of per-model arenas
+  static inline bool OptimizeMeshes = false;    // reorder for vertex cache, overdraw and fetch at import; false keeps file order
+  static inline unsigned int LodLevels = 4;    // LOD 0 plus up to LodLevels - 1 simplified index buffers; 1 disables LODs
+  static inline float LodMaxError = 0.25f;      // simplification stops at this error relative to the mesh's bounding sphere
+  static inline bool PackTextureArrays = false; // pack each material slot's textures into arrays so meshes share bindings
+  // index buffer bytes saved by 16-bit indices, summed over every Model loaded so far
+  static inline size_t IndexBytesSaved = 0;
+
   vector<Texture> textures_loaded;
   vector<Mesh> meshes;
+  SceneGraph nodes; // aiNode hierarchy; meshes[i] is placed by nodes.world[meshes[i].node]
   string directory;
   bool gammaCorrection;
+  bool loadedFromCache = false;
+  double loadMilliseconds = 0.0;
+  // results of the last culled Draw
+  unsigned int visibleCount = 0;
+  unsigned int culledCount = 0;
+  // triangles of the last Draw as submitted and as they would have been at LOD 0
+  size_t submittedTriangles = 0;
+  size_t fullTriangles = 0;
+  TextureArrays textureArrays; // filled with PackTextureArrays
 
   Model(const string &path, bool gamma = false) : gammaCorrection(gamma)
   {
+    if (!ShareSceneGeometry)
+      geometry = make_unique<GeometryArenas>();
     loadModel(path);
+    if (PackTextureArrays)
+      packTextureArrays();
   }
 
+  // textures are shared through the TextureCache, so a Model can be moved but not copied
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
+  Model(Model &&) = default;
+
+  ~Model()
+  {
+    Release();
+  }
+
+  // returns the textures and geometry and deletes the GL objects; call it while the context is
+  // still current, the destructor only catches models that were never released
+  void Release()
+  {
+    for (const Texture &texture : textures_loaded)
+      TextureCache::Instance().Release(texture.id);
+    textures_loaded.clear();
+    textureIndex.clear();
+    for (Mesh &mesh : meshes)
+    {
+      mesh.FreeGeometry();
+      mesh.material.Release();
+    }
+    meshes.clear();
+    if (geometry)
+      geometry->Release();
+    textureArrays.Release();
+  }
+
+  // draws with whatever "model" the caller set, ignoring node transforms
   void Draw(Shader &shader)
   {
-    for (unsigned int i = 0; i < meshes.size(); i++)
-      meshes[i].Draw(shader);
+    drawMeshes(shader, nullptr, nullptr);
+  }
+
+  // sets "model" to transform * node world matrix for each mesh
+  void Draw(Shader &shader, const glm::mat4 &transform)
+  {
+    Draw(shader, transform, nullptr, nullptr);
+  }
+
+  // as above, drawing only the meshes whose placed bounds intersect the frustum
+  void Draw(Shader &shader, const Frustum &frustum, const glm::mat4 &transform)
+  {
+    Draw(shader, transform, &frustum, nullptr);
+  }
+
+  // as above with optional culling, and with a lodView each mesh drawn at the LOD its projected size allows
+  // (and the mip levels it needs requested from the MipStreamer)
+  void Draw(Shader &shader, const glm::mat4 &transform, const Frustum *frustum, const LodView *lodView)
+  {
+    nodes.Update();
+    const uint8_t *visible = nullptr;
+    if (frustum)
+    {
+      culler.Resize(meshes.size());
+      for (size_t i = 0; i < meshes.size(); i++)
+        culler.Set(i, TransformBounds(meshes[i].bounds, MeshTransform(i, transform)));
+      culler.Cull(*frustum);
+      visibleCount = culler.visibleCount;
+      culledCount = culler.culledCount;
+      visible = culler.visible.data();
+    }
+    if (lodView)
+    {
+      meshLods.resize(meshes.size(), 0);
+      bool streaming = MipStreamer::Instance().Enabled;
+      for (size_t i = 0; i < meshes.size(); i++)
+      {
+        bool requestMips = streaming && (!visible || visible[i]);
+        if (meshes[i].LodCount() <= 1 && !requestMips)
+          continue;
+        BoundingSphere sphere = TransformBounds(meshes[i].sphere, MeshTransform(i, transform));
+        if (meshes[i].LodCount() > 1)
+          meshLods[i] = lodView->Select(meshes[i].lodErrors, sphere, meshLods[i]);
+        if (requestMips)
+          RequestMeshMips(meshes[i], sphere, *lodView);
+      }
+    }
+    drawMeshes(shader, visible, &transform, lodView ? meshLods.data() : nullptr);
+  }
+
+  // model matrix of one mesh; nodes must be up to date
+  glm::mat4 MeshTransform(size_t mesh, const glm::mat4 &transform) const
+  {
+    return transform * nodes.world[meshes[mesh].node];
+  }
+
+  // arenas this model's meshes live in
+  GeometryArenas &Geometry()
+  {
+    return geometry ? *geometry : GeometryArenas::Scene();
   }
 
 private:
+  unordered_map<string, size_t> textureIndex; // material path -> textures_loaded slot
+  unique_ptr<GeometryArenas> geometry;         // only set when not sharing the scene arenas
+  FrustumCuller culler;
+  vector<uint8_t> meshLods; // LOD each mesh was last drawn at, for LodView hysteresis
+
+  // meshes sharing an arena share a VAO, so it is only rebound when the arena changes
+  void drawMeshes(Shader &shader, const uint8_t *visible, const glm::mat4 *transform, const uint8_t *lods = nullptr)
+  {
+    unsigned int boundVAO = 0;
+    int boundNode = -1;
+    const Material *boundMaterial = nullptr;
+    submittedTriangles = fullTriangles = 0;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+      if (visible && !visible[i])
+        continue;
+      unsigned int lod = lods ? lods[i] : 0;
+      submittedTriangles += meshes[i].LodRange(lod).indexCount / 3;
+      fullTriangles += meshes[i].range.indexCount / 3;
+      if (transform && int(meshes[i].node) != boundNode)
+      {
+        boundNode = meshes[i].node;
+        shader.setMat4("model"_u, MeshTransform(i, *transform));
+      }
+      meshes[i].material.Bind(shader, boundMaterial);
+      boundMaterial = &meshes[i].material;
+      if (meshes[i].VAO != boundVAO)
+      {
+        boundVAO = meshes[i].VAO;
+        glBindVertexArray(boundVAO);
+      }
+      meshes[i].DrawRange(lod);
+    }
+
+    // reset
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
   /*
    * loads a model with supported ASSIMP extensions from file and stores the resulting
    * meshes in the meshes vector.
    */
   void loadModel(const string &path)
   {
-    // Read file via assimp
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    PROFILE_SCOPE("Model::loadModel");
+    auto start = chrono::steady_clock::now();
+    directory = path.substr(0, path.find_last_of("/"));
+
+    uint64_t sourceHash = UseMeshCache ? MeshCache::SourceHash(path) : 0;
+    string cachePath = MeshCache::PathFor(path);
+    unsigned int lodLevels = max(1u, min(LodLevels, MESH_CACHE_MAX_LODS));
+    uint32_t cacheOptions = (OptimizeMeshes ? MODEL_CACHE_OPTIMIZED : 0) | (Mesh::ShortIndices ? MODEL_CACHE_SPLIT : 0) |
+                            lodLevels << MODEL_CACHE_LOD_SHIFT;
+    if (sourceHash != 0)
+      loadedFromCache = loadFromCache(cachePath, sourceHash, cacheOptions);
+
+    if (!loadedFromCache)
     {
-      cout << "ERROR: ASSIMP:: " << importer.GetErrorString() << endl;
+      // Read file via assimp
+      Assimp::Importer importer;
+      const aiScene *scene = nullptr;
+      {
+        PROFILE_SCOPE("assimp ReadFile");
+        scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+      }
+      if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+      {
+        cout << "ERROR: ASSIMP:: " << importer.GetErrorString() << endl;
+        return;
+      }
+      vector<aiMesh *> sceneMeshes;
+      vector<unsigned int> meshNodes;
+      processNode(scene->mRootNode, scene, -1, sceneMeshes, meshNodes);
+
+      // convert every aiMesh independently, then create the GL meshes in node order
+      vector<MeshData> converted(sceneMeshes.size());
+      auto convert = [&](size_t i)
+      {
+        PROFILE_SCOPE("processMesh");
+        converted[i] = processMesh(sceneMeshes[i], scene);
+        converted[i].node = meshNodes[i];
+      };
+      if (ParallelImport && sceneMeshes.size() > 1)
+        WorkerPool().ParallelFor(sceneMeshes.size(), convert);
+      else
+        for (size_t i = 0; i < sceneMeshes.size(); i++)
+          convert(i);
+
+      if (ReportLoadStats)
+        for (size_t i = 0; i < converted.size(); i++)
+          printMeshStats(i, converted[i].stats);
+      if (Mesh::ShortIndices)
+        splitLargeMeshes(converted);
+      if (lodLevels > 1)
+      {
+        auto simplify = [&](size_t i)
+        {
+          PROFILE_SCOPE("generateLods");
+          generateLods(converted[i], lodLevels);
+        };
+        if (ParallelImport && converted.size() > 1)
+          WorkerPool().ParallelFor(converted.size(), simplify);
+        else
+          for (size_t i = 0; i < converted.size(); i++)
+            simplify(i);
+      }
+
+      meshes.reserve(converted.size());
+      for (MeshData &data : converted)
+        meshes.push_back(buildMesh(data));
+
+      if (sourceHash != 0 && !MeshCache::Write(cachePath, sourceHash, MODEL_IMPORT_FLAGS, meshes, nodes, cacheOptions))
+        cout << "WARNING::MESH_CACHE:: failed to write " << cachePath << endl;
+    }
+
+    loadMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    for (const Mesh &mesh : meshes)
+      IndexBytesSaved += mesh.range.indexCount * (sizeof(unsigned int) - mesh.range.IndexSize());
+    if (ReportLoadStats)
+    {
+      cout << "MODEL::LOAD " << path << (loadedFromCache ? " warm (mesh cache): " : " cold (assimp): ")
+           << loadMilliseconds << " ms" << endl;
+      printVertexStats();
+      printIndexStats();
+      printLodStats();
+      Geometry().PrintStats();
+    }
+  }
+
+  /*
+   * simplifies each LOD from the previous one to half its triangles, stopping when a level
+   * would save less than 20% or exceed LodMaxError; errors accumulate over the chain
+   */
+  static void generateLods(MeshData &data, unsigned int levels)
+  {
+    if (data.indices.size() < 3 * 64 || data.sphere.radius <= 0.0f)
       return;
+    const vector<unsigned int> *previous = &data.indices;
+    float error = 0.0f;
+    for (unsigned int level = 1; level < levels; level++)
+    {
+      float levelError;
+      size_t target = previous->size() / 6 * 3;
+      vector<unsigned int> lod = SimplifyMesh(data.vertices, *previous, target, LodMaxError * data.sphere.radius, &levelError);
+      if (lod.empty() || lod.size() > previous->size() * 4 / 5)
+        break;
+      error += levelError;
+      data.lodIndices.push_back(OptimizeVertexCache(lod, data.vertices.size()));
+      data.lodErrors.push_back(error / data.sphere.radius);
+      previous = &data.lodIndices.back();
     }
-    directory = path.substr(0, path.find_last_of("/"));
-    processNode(scene->mRootNode, scene);
   }
 
-  void processNode(aiNode *node, const aiScene *scene)
+  // replaces every mesh with too many vertices for 16-bit indices by SplitMesh chunks
+  void splitLargeMeshes(vector<MeshData> &converted) const
+  {
+    vector<MeshData> split;
+    split.reserve(converted.size());
+    for (size_t i = 0; i < converted.size(); i++)
+    {
+      MeshData &data = converted[i];
+      if (data.vertices.size() <= MAX_SHORT_INDEX_VERTICES)
+      {
+        split.push_back(std::move(data));
+        continue;
+      }
+      vector<MeshChunk> chunks = SplitMesh(data.vertices, data.indices, MAX_SHORT_INDEX_VERTICES);
+      if (ReportLoadStats)
+        printf("MODEL::SPLIT mesh %zu: %zu vertices -> %zu chunks\n", i, data.vertices.size(), chunks.size());
+      for (MeshChunk &chunk : chunks)
+      {
+        MeshData piece;
+        piece.vertices = std::move(chunk.vertices);
+        piece.indices = std::move(chunk.indices);
+        piece.textures = data.textures;
+        piece.constants = data.constants;
+        piece.node = data.node;
+        ComputeBounds(piece);
+        split.push_back(std::move(piece));
+      }
+    }
+    converted.swap(split);
+  }
+
+  // vertex buffer size with the full Vertex layout versus what was actually uploaded
+  void printVertexStats() const
+  {
+    size_t vertexCount = 0, uploadedBytes = 0;
+    for (const Mesh &mesh : meshes)
+    {
+      vertexCount += mesh.vertices.size();
+      uploadedBytes += mesh.vertices.size() * mesh.VertexStride();
+    }
+    if (vertexCount == 0)
+      return;
+    printf("MODEL::VERTICES %zu vertices, %zu -> %.1f bytes/vertex (%.2f MB -> %.2f MB)\n", vertexCount, sizeof(Vertex),
+           double(uploadedBytes) / vertexCount, vertexCount * sizeof(Vertex) / 1048576.0, uploadedBytes / 1048576.0);
+  }
+
+  // index buffer size with 32-bit indices versus what was actually uploaded
+  void printIndexStats() const
+  {
+    size_t indexCount = 0, uploadedBytes = 0, shortMeshes = 0;
+    for (const Mesh &mesh : meshes)
+    {
+      indexCount += mesh.range.indexCount;
+      uploadedBytes += mesh.range.indexCount * mesh.range.IndexSize();
+      shortMeshes += mesh.range.indexType == GL_UNSIGNED_SHORT;
+    }
+    if (indexCount == 0)
+      return;
+    printf("MODEL::INDICES %zu indices, %zu of %zu meshes 16-bit (%.2f MB -> %.2f MB, %zu bytes saved)\n", indexCount, shortMeshes,
+           meshes.size(), indexCount * sizeof(unsigned int) / 1048576.0, uploadedBytes / 1048576.0,
+           indexCount * sizeof(unsigned int) - uploadedBytes);
+  }
+
+  // triangles per LOD summed over the meshes (meshes with fewer LODs count their coarsest)
+  void printLodStats() const
+  {
+    unsigned int levels = 0;
+    for (const Mesh &mesh : meshes)
+      levels = max(levels, mesh.LodCount());
+    if (levels < 2)
+      return;
+    printf("MODEL::LODS triangles");
+    for (unsigned int lod = 0; lod < levels; lod++)
+    {
+      size_t triangles = 0;
+      for (const Mesh &mesh : meshes)
+        triangles += mesh.LodRange(min(lod, mesh.LodCount() - 1)).indexCount / 3;
+      printf(" %s%zu", lod > 0 ? "/ " : "", triangles);
+    }
+    printf("\n");
+  }
+
+  // per-mesh ACMR/ATVR (FIFO cache of VERTEX_CACHE_SIZE) and overdraw, file order -> optimized order
+  void printMeshStats(size_t mesh, const MeshOptimizerStats &stats) const
   {
+    if (!OptimizeMeshes)
+    {
+      printf("MODEL::MESH %zu: %zu triangles, ACMR %.3f, ATVR %.3f, overdraw %.3f (unoptimized)\n", mesh, stats.triangles,
+             stats.rawCache.acmr, stats.rawCache.atvr, stats.rawOverdraw.overdraw);
+      return;
+    }
+    printf("MODEL::MESH %zu: %zu triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f\n", mesh, stats.triangles,
+           stats.rawCache.acmr, stats.cache.acmr, stats.rawCache.atvr, stats.cache.atvr, stats.rawOverdraw.overdraw,
+           stats.overdraw.overdraw);
+  }
+
+  /*
+   * rebuilds the meshes from a mapped mesh cache file, skipping Assimp entirely.
+   * Textures are still resolved through textures_loaded so each image loads once.
+   */
+  bool loadFromCache(const string &cachePath, uint64_t sourceHash, uint32_t options)
+  {
+    PROFILE_SCOPE("MeshCache load");
+    MeshCache cache;
+    if (!cache.Load(cachePath, sourceHash, MODEL_IMPORT_FLAGS, options))
+      return false;
+
+    nodes = std::move(cache.nodes);
+    if (nodes.Size() == 0)
+      nodes.AddNode(-1, glm::mat4(1.0f));
+
+    meshes.reserve(cache.meshes.size());
+    for (CachedMesh &cached : cache.meshes)
+    {
+      MeshData data;
+      data.vertices.assign(cached.vertices, cached.vertices + cached.vertexCount);
+      data.indices.assign(cached.indices, cached.indices + cached.indexCount);
+      data.textures = std::move(cached.textures);
+      data.constants = cached.constants;
+      data.node = cached.node;
+      for (size_t i = 0; i < cached.lodIndices.size(); i++)
+      {
+        data.lodIndices.emplace_back(cached.lodIndices[i], cached.lodIndices[i] + cached.lodIndexCounts[i]);
+        data.lodErrors.push_back(cached.lodErrors[i]);
+      }
+      ComputeBounds(data);
+      meshes.push_back(buildMesh(data));
+    }
+    return true;
+  }
+
+  /*
+   * mirrors the aiNode tree into nodes (depth-first, keeping each mTransformation) and
+   * collects the scene's meshes in the same order, which is the order they are drawn in
+   */
+  void processNode(aiNode *node, const aiScene *scene, int parent, vector<aiMesh *> &sceneMeshes, vector<unsigned int> &meshNodes)
+  {
+    // aiMatrix4x4 is row-major
+    int index = nodes.AddNode(parent, glm::transpose(glm::make_mat4(&node->mTransformation.a1)), node->mName.C_Str());
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
-      aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-      meshes.push_back(processMesh(mesh, scene));
+      sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+      meshNodes.push_back(index);
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-      processNode(node->mChildren[i], scene);
+      processNode(node->mChildren[i], scene, index, sceneMeshes, meshNodes);
+    }
+  }
+
+  /*
+   * packs the first texture of every slot into TextureArrays, one array per size/format bucket,
+   * and points the materials at their layers. 2D textures no material binds anymore are released.
+   */
+  void packTextureArrays()
+  {
+    PROFILE_SCOPE("Model::packTextureArrays");
+    if (TextureStreamer::Instance().PendingTextures() > 0)
+      TextureStreamer::Instance().Flush(); // copy the images, not their placeholders
+    for (unsigned int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+    {
+      vector<unsigned int> textures;
+      for (const Mesh &mesh : meshes)
+        for (const Material::Binding &binding : mesh.material.bindings)
+          if (binding.unit == Material::UnitFor(slot, 0) && find(textures.begin(), textures.end(), binding.textureID) == textures.end())
+            textures.push_back(binding.textureID);
+      if (textures.empty())
+        continue;
+
+      MipOptions options;
+      options.srgb = slot == SLOT_DIFFUSE; // as TextureFromFile loaded them
+      options.normalMap = slot == SLOT_NORMAL;
+      vector<TextureArrays::Location> locations = textureArrays.Pack(textures, options);
+      for (Mesh &mesh : meshes)
+      {
+        const vector<Material::Binding> &bindings = mesh.material.bindings;
+        auto binding = find_if(bindings.begin(), bindings.end(),
+                               [&](const Material::Binding &b) { return b.unit == Material::UnitFor(slot, 0); });
+        if (binding == bindings.end())
+          continue;
+        TextureArrays::Location location = locations[find(textures.begin(), textures.end(), binding->textureID) - textures.begin()];
+        if (location.arrayID != 0)
+          mesh.material.UseArray(slot, location.arrayID, location.layer);
+      }
+    }
+
+    vector<Texture> kept;
+    for (const Texture &texture : textures_loaded)
+    {
+      bool bound = false;
+      for (const Mesh &mesh : meshes)
+        for (const Material::Binding &binding : mesh.material.bindings)
+          bound = bound || binding.textureID == texture.id;
+      if (bound)
+        kept.push_back(texture);
+      else
+        TextureCache::Instance().Release(texture.id);
     }
+    textures_loaded = std::move(kept);
+    textureIndex.clear();
+    for (size_t i = 0; i < textures_loaded.size(); i++)
+      textureIndex[textures_loaded[i].path] = i;
+    if (ReportLoadStats)
+      textureArrays.PrintStats();
   }
 
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+  // resolves texture references and uploads the mesh; must run on the GL context thread
+  Mesh buildMesh(MeshData &data)
   {
-    vector<Vertex> vertices;
-    vector<unsigned int> indices;
+    PROFILE_SCOPE("buildMesh");
     vector<Texture> textures;
+    for (const Texture &ref : data.textures)
+      textures.push_back(findOrLoadTexture(ref.path.c_str(), ref.type));
+    float uvDensity = ComputeUvDensity(data.vertices, data.indices);
+    Mesh mesh(std::move(data.vertices), std::move(data.indices), std::move(textures), data.constants, &Geometry());
+    mesh.bounds = data.bounds;
+    mesh.sphere = data.sphere;
+    mesh.node = data.node;
+    mesh.uvDensity = uvDensity;
+    for (size_t i = 0; i < data.lodIndices.size(); i++)
+      mesh.AddLod(std::move(data.lodIndices[i]), data.lodErrors[i]);
+    return mesh;
+  }
+
+  // converts one aiMesh to CPU-side buffers; touches no GL or Model state so it can run on any thread
+  MeshData processMesh(const aiMesh *mesh, const aiScene *scene)
+  {
+    MeshData data;
+    vector<Vertex> &vertices = data.vertices;
+    vector<unsigned int> &indices = data.indices;
+    vector<Texture> &textures = data.textures;
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(mesh->mNumFaces * 3);
 
     /*
      * Walk through each of the mesh's vertices
      */
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-      Vertex vertex;
+      Vertex vertex = {}; // zeroed so unused bone slots serialize deterministically
       glm::vec3 vector;
       vector.x = mesh->mVertices[i].x;
       vector.y = mesh->mVertices[i].y;
@@ -134,8 +673,34 @@ private:
       }
     }
 
+    if (ReportLoadStats)
+    {
+      data.stats.triangles = indices.size() / 3;
+      data.stats.rawCache = AnalyzeVertexCache(indices, vertices.size());
+      data.stats.rawOverdraw = AnalyzeOverdraw(indices, vertices);
+    }
+    if (OptimizeMeshes)
+    {
+      OptimizeMesh(vertices, indices);
+      if (ReportLoadStats)
+      {
+        data.stats.cache = AnalyzeVertexCache(indices, vertices.size());
+        data.stats.overdraw = AnalyzeOverdraw(indices, vertices);
+      }
+    }
+    ComputeBounds(data);
+
     aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
 
+    aiColor3D color;
+    float shininess;
+    if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS)
+      data.constants.diffuseColor = glm::vec4(color.r, color.g, color.b, 1.0f);
+    if (material->Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS)
+      data.constants.specularColor = glm::vec4(color.r, color.g, color.b, data.constants.specularColor.w);
+    if (material->Get(AI_MATKEY_SHININESS, shininess) == aiReturn_SUCCESS && shininess > 0.0f)
+      data.constants.specularColor.w = shininess;
+
     vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
     textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 
@@ -148,75 +713,117 @@ private:
     vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
     textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-    return Mesh(vertices, indices, textures);
+    return data;
   }
 
-  vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+  // lists the material's textures of one type; they are loaded later by buildMesh
+  vector<Texture> loadMaterialTextures(const aiMaterial *mat, aiTextureType type, string typeName)
   {
     vector<Texture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
       aiString str;
       mat->GetTexture(type, i, &str);
-      bool skip = false;
-      for (unsigned int j = 0; j < textures_loaded.size(); j++)
-      {
-        if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-        {
-          textures.push_back(textures_loaded[j]);
-          skip = true;
-          break;
-        }
-      }
-      if (!skip)
-      {
-        Texture texture;
-        texture.id = TextureFromFile(str.C_Str(), this->directory);
-        texture.type = typeName;
-        texture.path = str.C_Str();
-        textures.push_back(texture);
-        textures_loaded.push_back(texture);
-      }
+      Texture texture;
+      texture.id = 0;
+      texture.type = typeName;
+      texture.path = str.C_Str();
+      textures.push_back(texture);
     }
     return textures;
   }
+
+  // returns the texture for a material path relative to the model, acquiring it only once per model
+  Texture findOrLoadTexture(const char *path, const string &typeName)
+  {
+    auto found = textureIndex.find(path);
+    if (found != textureIndex.end())
+      return textures_loaded[found->second];
+
+    Texture texture;
+    // diffuse maps hold sRGB colour, the others are data; the arrays copy whole mip chains,
+    // which streamed textures do not keep resident
+    texture.id = TextureFromFile(path, this->directory, typeName == "texture_diffuse", !PackTextureArrays);
+    texture.type = typeName;
+    texture.path = path;
+    textureIndex[texture.path] = textures_loaded.size();
+    textures_loaded.push_back(texture);
+    return texture;
+  }
 };
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, bool stream)
 {
   string filename = string(path);
   filename = directory + '/' + filename;
 
+  return TextureCache::Instance().Acquire(filename, [&](size_t &bytes) { return TextureFromFileUncached(filename, bytes, gamma, stream); }, gamma);
+}
+
+unsigned int TextureFromFileUncached(const string &filename, size_t &bytes, bool gamma, bool stream)
+{
+  int width, height, nrComponents;
+  if (stream && MipStreamer::Instance().Enabled)
+  {
+    // only the mip tail for now, finer levels once the draws need them
+    unsigned int streamed = MipStreamer::Instance().Load(filename, gamma, bytes);
+    if (streamed)
+      return streamed;
+  }
+  if (TextureCompression::Instance().Enabled)
+  {
+    // block-compressed from <image>.dds, transcoded on the first load
+    unsigned int compressed = TextureCompression::Instance().LoadTexture2D(filename, bytes, gamma);
+    if (compressed)
+      return compressed;
+  }
+  if (TextureStreamer::Instance().Enabled)
+  {
+    // decode on a worker, sample a placeholder until the upload completes
+    if (stbi_info(filename.c_str(), &width, &height, &nrComponents))
+      bytes = TextureBytes(width, height, nrComponents, true);
+    return TextureStreamer::Instance().LoadAsync(filename, gamma);
+  }
+
   unsigned int textureID;
   glGenTextures(1, &textureID);
 
-  int width, height, nrComponents;
   unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-  if (data)
+  // 0 when stb_image failed or the image has no matching GL format; both are load failures
+  GLenum format = data ? TextureFormat(nrComponents) : 0;
+  if (format)
   {
-    GLenum format;
-    if (nrComponents == 1)
-      format = GL_RED;
-    else if (nrComponents == 3)
-      format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
-
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    if (MipBuilder::Instance().Enabled)
+    {
+      // mips on the WorkerPool, colour filtered in linear light
+      MipOptions options;
+      options.srgb = gamma;
+      MipBuilder::Upload(GL_TEXTURE_2D, MipBuilder::Instance().Build(data, width, height, nrComponents, options), format, format);
+    }
+    else
+    {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // stb_image rows are tightly packed
+      glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    bytes = TextureBytes(width, height, nrComponents, true);
     stbi_image_free(data);
   }
   else
   {
-    cout << "Texture failed to laod at path: " << path << endl;
+    cout << "Texture failed to load at path: " << filename << endl;
     stbi_image_free(data);
+    // 0 tells the TextureCache the load failed, so it is not cached and a later Acquire retries
+    glDeleteTextures(1, &textureID);
+    return 0;
   }
 
   return textureID;
@@ -0,0 +1,296 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * CPU and GPU pass timing, exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ *
+ *   PROFILE_SCOPE("name")      times the enclosing block on the calling thread (any thread)
+ *   PROFILE_GPU_SCOPE("name")  as above, plus GL timestamps around the block (GL thread only)
+ *   PROFILE_FRAME()            once per frame before any GPU scope; collects finished queries
+ *   PROFILE_EXPORT("path")     writes every event still in the ring
+ *
+ * Names must be string literals, they are stored as pointers. Everything compiles to nothing
+ * unless LEARNOPENGL_PROFILE is defined.
+ */
+#ifdef LEARNOPENGL_PROFILE
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+#define PROFILE_FRAME() GpuProfiler::Instance().BeginFrame()
+#define PROFILE_EXPORT(path) Profiler::Instance().WriteChromeTrace(path)
+
+// thread id reported for GPU events, so they show up as their own track
+const uint32_t PROFILE_GPU_THREAD = 0;
+
+struct TraceEvent
+{
+  const char *name = nullptr;
+  uint64_t start = 0;    // ns since Profiler::epoch
+  uint64_t duration = 0; // ns
+  uint32_t thread = 0;
+};
+
+/*
+ * Fixed-size multi-producer ring of TraceEvents. A writer claims a slot with one fetch_add and
+ * publishes it through the slot's sequence number, so recording never locks and never
+ * allocates; when the ring is full the oldest events are overwritten. The payload is copied
+ * through relaxed atomics between the sequence updates (a seqlock), so Events() may run while
+ * other threads record. A writer that finds its slot taken by a newer event, or by a writer
+ * that lapped it, drops its event rather than mixing the two.
+ */
+class Profiler
+{
+public:
+  static const size_t Capacity = 1 << 16; // power of two
+
+  static Profiler &Instance()
+  {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  uint64_t Now() const
+  {
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count());
+  }
+
+  // small sequential id of the calling thread, starting at 1
+  static uint32_t ThreadId()
+  {
+    static atomic<uint32_t> nextId(1);
+    thread_local uint32_t id = nextId.fetch_add(1);
+    return id;
+  }
+
+  void Record(const TraceEvent &event)
+  {
+    uint64_t index = head.fetch_add(1, memory_order_relaxed);
+    Slot &slot = slots[index & (Capacity - 1)];
+    uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+    do
+    {
+      if (sequence == Busy || sequence > index)
+        return;
+    } while (!slot.sequence.compare_exchange_weak(sequence, Busy, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release); // readers that see the new payload see Busy too
+    slot.name.store(event.name, memory_order_relaxed);
+    slot.start.store(event.start, memory_order_relaxed);
+    slot.duration.store(event.duration, memory_order_relaxed);
+    slot.thread.store(event.thread, memory_order_relaxed);
+    slot.sequence.store(index + 1, memory_order_release);
+  }
+
+  // events still in the ring, oldest first; slots being overwritten meanwhile are skipped
+  vector<TraceEvent> Events() const
+  {
+    vector<TraceEvent> events;
+    uint64_t end = head.load(memory_order_acquire);
+    uint64_t begin = end > Capacity ? end - Capacity : 0;
+    events.reserve(size_t(end - begin));
+    for (uint64_t index = begin; index < end; index++)
+    {
+      const Slot &slot = slots[index & (Capacity - 1)];
+      if (slot.sequence.load(memory_order_acquire) != index + 1)
+        continue;
+      TraceEvent event;
+      event.name = slot.name.load(memory_order_relaxed);
+      event.start = slot.start.load(memory_order_relaxed);
+      event.duration = slot.duration.load(memory_order_relaxed);
+      event.thread = slot.thread.load(memory_order_relaxed);
+      atomic_thread_fence(memory_order_acquire);
+      if (slot.sequence.load(memory_order_relaxed) == index + 1)
+        events.push_back(event);
+    }
+    return events;
+  }
+
+  bool WriteChromeTrace(const string &path) const
+  {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+      cout << "ERROR::PROFILER::WRITE_FAILED " << path << endl;
+      return false;
+    }
+    vector<TraceEvent> events = Events();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", PROFILE_GPU_THREAD);
+    for (const TraceEvent &event : events)
+      fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", event.name,
+              event.thread == PROFILE_GPU_THREAD ? "gpu" : "cpu", event.thread, event.start / 1000.0, event.duration / 1000.0);
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("PROFILER:: %zu events written to %s\n", events.size(), path.c_str());
+    return true;
+  }
+
+private:
+  static const uint64_t Busy = ~uint64_t(0); // sequence while a writer fills the slot
+
+  // the fields of a TraceEvent
+  struct Slot
+  {
+    atomic<uint64_t> sequence{0}; // index + 1 once the event is complete
+    atomic<const char *> name{nullptr};
+    atomic<uint64_t> start{0};
+    atomic<uint64_t> duration{0};
+    atomic<uint32_t> thread{0};
+  };
+
+  chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+  atomic<uint64_t> head{0};
+  vector<Slot> slots = vector<Slot>(Capacity);
+};
+
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char *name) : name(name), start(Profiler::Instance().Now()) {}
+
+  ~ProfileScope()
+  {
+    Profiler &profiler = Profiler::Instance();
+    TraceEvent event;
+    event.name = name;
+    event.start = start;
+    event.duration = profiler.Now() - start;
+    event.thread = Profiler::ThreadId();
+    profiler.Record(event);
+  }
+
+private:
+  const char *name;
+  uint64_t start;
+};
+
+/*
+ * GL_TIMESTAMP queries around GPU scopes. Queries issued in frame N are read in frame N + 2,
+ * when the GPU has normally finished them; results that are still not available are dropped
+ * instead of waited for, so the profiler never stalls the pipeline. Timestamps (rather than
+ * GL_TIME_ELAPSED) let scopes nest. GPU times are moved onto the CPU timeline with a
+ * GL_TIMESTAMP read taken when the frame began.
+ */
+class GpuProfiler
+{
+public:
+  unsigned int dropped = 0; // scopes whose results were not ready in time
+
+  static GpuProfiler &Instance()
+  {
+    static GpuProfiler profiler;
+    return profiler;
+  }
+
+  void BeginFrame()
+  {
+    frame++;
+    Frame &current = frames[frame % 2];
+    collect(current);
+    current.used = 0;
+    // offset between the GPU clock and Profiler::Now for this frame's results
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    current.gpuToCpu = int64_t(Profiler::Instance().Now()) - int64_t(gpuNow);
+  }
+
+  // returns the scope's index in this frame
+  size_t Begin(const char *name)
+  {
+    Frame &current = frames[frame % 2];
+    if (current.used == current.scopes.size())
+    {
+      Scope scope;
+      glGenQueries(2, scope.queries);
+      current.scopes.push_back(scope);
+    }
+    Scope &scope = current.scopes[current.used];
+    scope.name = name;
+    glQueryCounter(scope.queries[0], GL_TIMESTAMP);
+    return current.used++;
+  }
+
+  void End(size_t index)
+  {
+    glQueryCounter(frames[frame % 2].scopes[index].queries[1], GL_TIMESTAMP);
+  }
+
+private:
+  struct Scope
+  {
+    const char *name = nullptr;
+    unsigned int queries[2] = {0, 0}; // begin and end timestamps
+  };
+  struct Frame
+  {
+    vector<Scope> scopes;
+    size_t used = 0;
+    int64_t gpuToCpu = 0;
+  };
+  Frame frames[2];
+  uint64_t frame = 0;
+
+  void collect(Frame &finished)
+  {
+    Profiler &profiler = Profiler::Instance();
+    for (size_t i = 0; i < finished.used; i++)
+    {
+      Scope &scope = finished.scopes[i];
+      GLint available = 0;
+      glGetQueryObjectiv(scope.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+      {
+        dropped++;
+        continue;
+      }
+      GLuint64 begin = 0, end = 0;
+      glGetQueryObjectui64v(scope.queries[0], GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(scope.queries[1], GL_QUERY_RESULT, &end);
+      TraceEvent event;
+      event.name = scope.name;
+      event.start = uint64_t(max<int64_t>(int64_t(begin) + finished.gpuToCpu, 0));
+      event.duration = end > begin ? end - begin : 0;
+      event.thread = PROFILE_GPU_THREAD;
+      profiler.Record(event);
+    }
+  }
+};
+
+class GpuProfileScope
+{
+public:
+  explicit GpuProfileScope(const char *name) : cpu(name), index(GpuProfiler::Instance().Begin(name)) {}
+
+  ~GpuProfileScope()
+  {
+    GpuProfiler::Instance().End(index);
+  }
+
+private:
+  ProfileScope cpu;
+  size_t index;
+};
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_EXPORT(path) ((void)0)
+
+#endif
+
+#endif
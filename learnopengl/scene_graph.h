@@ -0,0 +1,126 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Node hierarchy stored as flat arrays in depth-first order: a node's parent always comes
+ * before it and its subtree is the contiguous range [i, subtreeEnd[i]). SetLocal only marks
+ * the node; Update then recomputes world = world[parent] * local for each marked subtree,
+ * so a frame where 1% of the nodes move costs about 1% of a full pass.
+ */
+class SceneGraph
+{
+public:
+  vector<int> parents;          // -1 for roots
+  vector<uint32_t> subtreeEnd;  // one past the last descendant
+  vector<glm::mat4> local;
+  vector<glm::mat4> world;
+  vector<string> names;
+
+  size_t Size() const
+  {
+    return parents.size();
+  }
+
+  // appends a node; nodes must be added depth-first (parent is on the path to the last node)
+  int AddNode(int parent, const glm::mat4 &transform, const string &name = string())
+  {
+    int node = static_cast<int>(parents.size());
+    if (parent >= node || (parent >= 0 && subtreeEnd[parent] != uint32_t(node)))
+    {
+      cout << "ERROR::SCENE_GRAPH:: nodes must be added in depth-first order" << endl;
+      return -1;
+    }
+    parents.push_back(parent);
+    subtreeEnd.push_back(node + 1);
+    local.push_back(transform);
+    world.push_back(parent >= 0 ? world[parent] * transform : transform);
+    names.push_back(name);
+    dirty.push_back(0);
+    for (int ancestor = parent; ancestor >= 0; ancestor = parents[ancestor])
+      subtreeEnd[ancestor] = node + 1;
+    return node;
+  }
+
+  void SetLocal(int node, const glm::mat4 &transform)
+  {
+    local[node] = transform;
+    if (!dirty[node])
+    {
+      dirty[node] = 1;
+      dirtyNodes.push_back(node);
+    }
+  }
+
+  // index of the first node with this name, or -1
+  int Find(const string &name) const
+  {
+    auto found = find(names.begin(), names.end(), name);
+    return found == names.end() ? -1 : int(found - names.begin());
+  }
+
+  // brings world matrices up to date; returns the number recomputed
+  unsigned int Update()
+  {
+    if (dirtyNodes.empty())
+      return 0;
+    sort(dirtyNodes.begin(), dirtyNodes.end());
+    unsigned int updated = 0;
+    uint32_t covered = 0; // nodes below this index were recomputed by an ancestor's range
+    for (uint32_t node : dirtyNodes)
+    {
+      dirty[node] = 0;
+      if (node < covered)
+        continue;
+      updated += updateRange(node, subtreeEnd[node]);
+      covered = subtreeEnd[node];
+    }
+    dirtyNodes.clear();
+    return updated;
+  }
+
+  // recomputes every world matrix, for reference
+  unsigned int UpdateAll()
+  {
+    for (uint32_t node : dirtyNodes)
+      dirty[node] = 0;
+    dirtyNodes.clear();
+    return updateRange(0, static_cast<uint32_t>(Size()));
+  }
+
+  void Clear()
+  {
+    parents.clear();
+    subtreeEnd.clear();
+    local.clear();
+    world.clear();
+    names.clear();
+    dirty.clear();
+    dirtyNodes.clear();
+  }
+
+private:
+  vector<uint8_t> dirty;
+  vector<uint32_t> dirtyNodes;
+
+  unsigned int updateRange(uint32_t first, uint32_t end)
+  {
+    for (uint32_t node = first; node < end; node++)
+    {
+      int parent = parents[node];
+      world[node] = parent >= 0 ? world[parent] * local[node] : local[node];
+    }
+    return end - first;
+  }
+};
+
+#endif
@@ -6,19 +6,76 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "gl_extensions.h"
+#include "profiler.h"
+
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+// uniform block binding points shared by every program; blocks with these names are bound at link time
+enum UniformBlockBinding
+{
+  MATERIAL_BLOCK_BINDING = 0,         // MaterialBlock, see material.h
+  CAMERA_BLOCK_BINDING = 1,           // CameraBlock, see camera.h
+  MATERIAL_TEXTURE_BLOCK_BINDING = 2  // MaterialTextureBlock, see material.h and bindless.h
+};
+
+// shader storage binding points (GL 4.3 programs declare them with layout(binding = N))
+enum StorageBlockBinding
+{
+  DRAW_DATA_BINDING = 0,        // DrawBlock, see indirect_draw.h
+  INSTANCE_DATA_BINDING = 1,    // InstanceBlock, see gpu_culling.h
+  VISIBLE_INSTANCE_BINDING = 2, // VisibleBlock
+  CULL_COUNT_BINDING = 3,       // CountBlock
+  INSTANCE_LOD_BINDING = 4,     // LodBlock
+  CULL_COMMAND_BINDING = 5      // CommandBlock
+};
+
+// 32-bit FNV-1a over a NUL-terminated name, usable at compile time
+constexpr uint32_t UniformHash(const char *name)
+{
+  uint32_t hash = 2166136261u;
+  while (*name)
+    hash = (hash ^ static_cast<unsigned char>(*name++)) * 16777619u;
+  return hash;
+}
+
+/*
+ * Uniform name plus its hash. String literals convert implicitly (hashed at runtime), while
+ * "model"_u or a constexpr UniformName is hashed by the compiler, leaving a single table probe.
+ */
+struct UniformName
+{
+  uint32_t hash;
+  const char *name;
+
+  constexpr UniformName(const char *name) : hash(UniformHash(name)), name(name) {}
+  UniformName(const std::string &name) : UniformName(name.c_str()) {}
+};
+
+constexpr UniformName operator""_u(const char *name, size_t)
+{
+  return UniformName(name);
+}
+
 class Shader
 {
 public:
   unsigned int ID;
+  // set by Material once the program's texture_<type><n> samplers point at their fixed units
+  mutable bool materialConfigured = false;
+  // the program declares MaterialTextureBlock and samples bindless handles, see material.h
+  bool materialHandles = false;
   // constructor generates the shader on the fly
   // ------------------------------------------------------------------------
   Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr)
   {
+    PROFILE_SCOPE("Shader compile");
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
     std::string fragmentCode;
@@ -59,6 +116,10 @@ public:
     {
       std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
     }
+    vertexCode = expandIncludes(vertexCode, vertexPath);
+    fragmentCode = expandIncludes(fragmentCode, fragmentPath);
+    if (geometryPath != nullptr)
+      geometryCode = expandIncludes(geometryCode, geometryPath);
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
@@ -74,7 +135,7 @@ public:
     glCompileShader(fragment);
     checkCompileErrors(fragment, "FRAGMENT");
     // if geometry shader is given, compile geometry shader
-    unsigned int geometry;
+    unsigned int geometry = 0;
     if (geometryPath != nullptr)
     {
       const char *gShaderCode = geometryCode.c_str();
@@ -91,78 +152,263 @@ public:
       glAttachShader(ID, geometry);
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
+    cacheUniformLocations();
+    bindUniformBlock("MaterialBlock", MATERIAL_BLOCK_BINDING);
+    bindUniformBlock("CameraBlock", CAMERA_BLOCK_BINDING);
+    bindUniformBlock("MaterialTextureBlock", MATERIAL_TEXTURE_BLOCK_BINDING);
+    materialHandles = glGetUniformBlockIndex(ID, "MaterialTextureBlock") != GL_INVALID_INDEX;
     // delete the shaders as they're linked into our program now and no longer necessery
     glDeleteShader(vertex);
     glDeleteShader(fragment);
     if (geometryPath != nullptr)
       glDeleteShader(geometry);
   }
+  // compute program from a single .comp file; needs a GL 4.3 context
+  // ------------------------------------------------------------------------
+  explicit Shader(const char *computePath)
+  {
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+      cShaderFile.open(computePath);
+      std::stringstream cShaderStream;
+      cShaderStream << cShaderFile.rdbuf();
+      cShaderFile.close();
+      computeCode = cShaderStream.str();
+    }
+    catch (std::ifstream::failure &e)
+    {
+      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+    }
+    computeCode = expandIncludes(computeCode, computePath);
+    const char *cShaderCode = computeCode.c_str();
+    unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, NULL);
+    glCompileShader(compute);
+    checkCompileErrors(compute, "COMPUTE");
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glLinkProgram(ID);
+    checkCompileErrors(ID, "PROGRAM");
+    cacheUniformLocations();
+    glDeleteShader(compute);
+  }
   // activate the shader
   // ------------------------------------------------------------------------
   void use()
   {
     glUseProgram(ID);
   }
-  // utility uniform functions
+  // attaches a uniform block of this program to a binding point, if the program uses it
+  void bindUniformBlock(const char *blockName, unsigned int binding) const
+  {
+    unsigned int index = glGetUniformBlockIndex(ID, blockName);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(ID, index, binding);
+  }
+  // utility uniform functions; locations come from the table built at link time
+  // ------------------------------------------------------------------------
+  GLint location(UniformName name) const
+  {
+    size_t mask = uniforms.size() - 1;
+    for (size_t i = name.hash & mask;; i = (i + 1) & mask)
+    {
+      const UniformSlot &slot = uniforms[i];
+      if (slot.name.empty())
+        return unknownUniform(name);
+      if (slot.hash == name.hash && slot.name == name.name)
+        return slot.location;
+    }
+  }
   // ------------------------------------------------------------------------
-  void setBool(const std::string &name, bool value) const
+  void setBool(UniformName name, bool value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(location(name), (int)value);
   }
   // ------------------------------------------------------------------------
-  void setInt(const std::string &name, int value) const
+  void setInt(UniformName name, int value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(location(name), value);
+  }
+  // bindless texture handle for a layout(bindless_sampler) uniform; needs ARB_bindless_texture
+  void setHandle(UniformName name, GLuint64 handle) const
+  {
+    glUniformHandleui64ARB(location(name), handle);
   }
   // ------------------------------------------------------------------------
-  void setFloat(const std::string &name, float value) const
+  void setFloat(UniformName name, float value) const
   {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(location(name), value);
   }
   // ------------------------------------------------------------------------
-  void setVec2(const std::string &name, const glm::vec2 &value) const
+  void setVec2(UniformName name, const glm::vec2 &value) const
   {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(location(name), 1, &value[0]);
   }
-  void setVec2(const std::string &name, float x, float y) const
+  void setVec2(UniformName name, float x, float y) const
   {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(location(name), x, y);
   }
   // ------------------------------------------------------------------------
-  void setVec3(const std::string &name, const glm::vec3 &value) const
+  void setVec3(UniformName name, const glm::vec3 &value) const
   {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(location(name), 1, &value[0]);
   }
-  void setVec3(const std::string &name, float x, float y, float z) const
+  void setVec3(UniformName name, float x, float y, float z) const
   {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(location(name), x, y, z);
   }
   // ------------------------------------------------------------------------
-  void setVec4(const std::string &name, const glm::vec4 &value) const
+  void setVec4(UniformName name, const glm::vec4 &value) const
   {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(location(name), 1, &value[0]);
   }
-  void setVec4(const std::string &name, float x, float y, float z, float w)
+  void setVec4(UniformName name, float x, float y, float z, float w)
   {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(location(name), x, y, z, w);
   }
   // ------------------------------------------------------------------------
-  void setMat2(const std::string &name, const glm::mat2 &mat) const
+  void setMat2(UniformName name, const glm::mat2 &mat) const
   {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
   }
   // ------------------------------------------------------------------------
-  void setMat3(const std::string &name, const glm::mat3 &mat) const
+  void setMat3(UniformName name, const glm::mat3 &mat) const
   {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
   }
   // ------------------------------------------------------------------------
-  void setMat4(const std::string &name, const glm::mat4 &mat) const
+  void setMat4(UniformName name, const glm::mat4 &mat) const
   {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
   }
 
 private:
+  // open-addressed table of the program's uniform locations, keyed by UniformHash
+  struct UniformSlot
+  {
+    uint32_t hash = 0;
+    GLint location = -1;
+    std::string name;
+  };
+  mutable std::vector<UniformSlot> uniforms;
+  mutable size_t uniformCount = 0;
+
+  /*
+   * replaces every '#include "file"' line with the file, resolved relative to the including one,
+   * so programs share declarations such as shaders/camera.glsl. #line directives keep compile
+   * errors pointing at the right line: source string 0 is the shader itself, n its n-th include.
+   */
+  static std::string expandIncludes(const std::string &source, const std::string &path)
+  {
+    int includes = 0;
+    return expandIncludes(source, path, 0, includes);
+  }
+
+  static std::string expandIncludes(const std::string &source, const std::string &path, int sourceNumber, int &includes)
+  {
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::istringstream lines(source);
+    std::string line, expanded;
+    int number = 0;
+    while (std::getline(lines, line))
+    {
+      number++;
+      size_t start = line.find_first_not_of(" \t");
+      if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+      {
+        expanded += line + '\n';
+        continue;
+      }
+      size_t open = line.find('"', start);
+      size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+      std::ifstream file;
+      std::string includePath;
+      if (close != std::string::npos && includes < 64) // the cap stops include cycles
+      {
+        includePath = directory + line.substr(open + 1, close - open - 1);
+        file.open(includePath);
+      }
+      if (!file.is_open())
+      {
+        std::cout << "ERROR::SHADER::INCLUDE_NOT_SUCCESFULLY_READ: " << line << " in " << path << std::endl;
+        continue;
+      }
+      std::stringstream included;
+      included << file.rdbuf();
+      int includeNumber = ++includes;
+      expanded += "#line 1 " + std::to_string(includeNumber) + '\n';
+      expanded += expandIncludes(included.str(), includePath, includeNumber, includes);
+      expanded += "#line " + std::to_string(number + 1) + ' ' + std::to_string(sourceNumber) + '\n';
+    }
+    return expanded;
+  }
+
+  void cacheUniformLocations()
+  {
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    size_t capacity = 16;
+    while (capacity < size_t(count) * 4)
+      capacity *= 2;
+    uniforms.assign(capacity, UniformSlot());
+    uniformCount = 0;
+
+    std::vector<GLchar> buffer(maxLength + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(ID, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+      std::string name(buffer.data(), length);
+      GLint loc = glGetUniformLocation(ID, name.c_str());
+      if (loc == -1) // uniform block members have no location
+        continue;
+      insertUniform(name, loc);
+      // arrays are reported as "name[0]"; also accept the bare name
+      if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        insertUniform(name.substr(0, name.size() - 3), loc);
+    }
+  }
+
+  void insertUniform(const std::string &name, GLint loc) const
+  {
+    if ((uniformCount + 1) * 2 > uniforms.size())
+    {
+      std::vector<UniformSlot> old;
+      old.swap(uniforms);
+      uniforms.assign(old.size() * 2, UniformSlot());
+      uniformCount = 0;
+      for (const UniformSlot &slot : old)
+        if (!slot.name.empty())
+          insertUniform(slot.name, slot.location);
+    }
+    uint32_t hash = UniformHash(name.c_str());
+    size_t mask = uniforms.size() - 1;
+    size_t i = hash & mask;
+    while (!uniforms[i].name.empty())
+      i = (i + 1) & mask;
+    uniforms[i].hash = hash;
+    uniforms[i].location = loc;
+    uniforms[i].name = name;
+    uniformCount++;
+  }
+
+  // asks GL for names the table does not list, such as "lights[1].x" or "offsets[3]", and remembers
+  // the answer; names the program does not have are reported once and kept as location -1
+  GLint unknownUniform(UniformName name) const
+  {
+    GLint loc = glGetUniformLocation(ID, name.name);
+    if (loc == -1)
+      std::cout << "WARNING::SHADER::UNKNOWN_UNIFORM '" << name.name << "' in program " << ID << std::endl;
+    insertUniform(name.name, loc);
+    return loc;
+  }
+
   // utility function for checking shader compilation/linking errors.
   // ------------------------------------------------------------------------
   void checkCompileErrors(GLuint shader, std::string type)
@@ -8,6 +8,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <bindless.h>
 #include <shader.h>
 
 using namespace std;
@@ -27,9 +28,16 @@ public:
 
   void Draw(Shader &shader)
   {
-    glActiveTexture(GL_TEXTURE0);
+    // the cubemap's bindless handle when the driver has one, see BindlessTextures
+    BindlessTextures &bindless = BindlessTextures::Instance();
+    if (bindless.SetSampler(shader, "skybox"_u, textureID))
+      bindless.bindsAvoided++;
+    else
+    {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    }
     glBindVertexArray(VAO);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
     glDrawArrays(GL_TRIANGLES, 0, 36);
 
     glBindVertexArray(0);
@@ -0,0 +1,348 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "bindless.h"
+#include "gl_extensions.h"
+#include "mip_builder.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Packs 2D textures into GL_TEXTURE_2D_ARRAYs, one array per bucket of equal size, format and
+ * level count, so meshes that used to bind different textures can share one binding and pick
+ * their image with a layer index. Model::PackTextureArrays packs each material slot this way.
+ *
+ * Levels are copied on the GPU with glCopyImageSubData on GL 4.3, read back and uploaded again
+ * otherwise; block-compressed levels are copied as they are. With Resample set, an uncompressed
+ * texture whose size differs from the most common size of its format is scaled to that size
+ * (bilinear, then a new chain from the MipBuilder) instead of getting a bucket of its own.
+ * Only complete textures whose chain starts at level 0 are packed, so textures the MipStreamer
+ * manages are left out. GL thread only.
+ */
+class TextureArrays
+{
+public:
+  static inline bool Resample = true;
+
+  // where Pack put a texture; arrayID 0 when it was left out
+  struct Location
+  {
+    unsigned int arrayID = 0;
+    int layer = -1;
+  };
+
+  vector<unsigned int> arrays; // owned, deleted by Release
+  size_t bytes = 0;            // GPU size of the arrays
+  unsigned int layers = 0;
+  unsigned int resampled = 0;
+
+  TextureArrays() = default;
+  TextureArrays(const TextureArrays &) = delete;
+  TextureArrays &operator=(const TextureArrays &) = delete;
+  TextureArrays(TextureArrays &&other) noexcept
+  {
+    *this = std::move(other);
+  }
+  TextureArrays &operator=(TextureArrays &&other) noexcept
+  {
+    swap(arrays, other.arrays);
+    swap(bytes, other.bytes);
+    swap(layers, other.layers);
+    swap(resampled, other.resampled);
+    return *this;
+  }
+
+  ~TextureArrays()
+  {
+    Release();
+  }
+
+  /*
+   * packs the given textures, all of one material slot, and returns their locations in the
+   * same order. options are the mip options of the slot, used for resampled layers.
+   */
+  vector<Location> Pack(const vector<unsigned int> &textures, const MipOptions &options)
+  {
+    PROFILE_SCOPE("TextureArrays::Pack");
+    vector<Source> sources(textures.size());
+    for (size_t i = 0; i < textures.size(); i++)
+      sources[i] = describe(textures[i]);
+
+    // the most common size of each uncompressed format is what the odd ones are scaled to
+    map<GLint, map<pair<int, int>, unsigned int>> sizeCounts;
+    for (const Source &source : sources)
+      if (source.levels > 0 && !source.compressed)
+        sizeCounts[source.internalFormat][{source.width, source.height}]++;
+
+    vector<Bucket> buckets;
+    vector<Location> locations(textures.size());
+    vector<pair<size_t, size_t>> members; // (bucket, source)
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+      Source &source = sources[i];
+      if (source.levels == 0)
+        continue;
+      int width = source.width, height = source.height, levels = source.levels;
+      if (Resample && !source.compressed)
+      {
+        const auto &counts = sizeCounts[source.internalFormat];
+        auto common = max_element(counts.begin(), counts.end(),
+                                  [](const auto &a, const auto &b) { return a.second < b.second; });
+        if (common->first != make_pair(width, height))
+        {
+          width = common->first.first;
+          height = common->first.second;
+          levels = fullChainLevels(width, height);
+          source.resample = true;
+        }
+      }
+      auto bucket = find_if(buckets.begin(), buckets.end(), [&](const Bucket &b)
+      {
+        return b.internalFormat == source.internalFormat && b.width == width && b.height == height && b.levels == levels;
+      });
+      if (bucket == buckets.end())
+        bucket = buckets.insert(buckets.end(), Bucket{source.internalFormat, source.compressed, width, height, levels, 0, 0});
+      locations[i].layer = bucket->layers++;
+      members.emplace_back(size_t(bucket - buckets.begin()), i);
+    }
+
+    for (Bucket &bucket : buckets)
+      allocate(bucket);
+    for (const auto &member : members)
+    {
+      Bucket &bucket = buckets[member.first];
+      Source &source = sources[member.second];
+      if (source.resample)
+        resampleLayer(bucket, source, locations[member.second].layer, options);
+      else
+        copyLayer(bucket, source, locations[member.second].layer);
+      locations[member.second].arrayID = bucket.id;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return locations;
+  }
+
+  void Release()
+  {
+    for (unsigned int array : arrays)
+      BindlessTextures::Instance().Forget(array);
+    if (!arrays.empty())
+      glDeleteTextures(GLsizei(arrays.size()), arrays.data());
+    arrays.clear();
+    bytes = 0;
+    layers = resampled = 0;
+  }
+
+  void PrintStats() const
+  {
+    printf("TEXTURE_ARRAYS:: %zu arrays, %u layers (%u resampled), %.1f MB\n", arrays.size(), layers, resampled, bytes / 1048576.0);
+  }
+
+private:
+  struct Source
+  {
+    unsigned int id = 0;
+    GLint internalFormat = 0;
+    bool compressed = false;
+    bool resample = false;
+    int width = 0, height = 0;
+    int levels = 0; // 0 when the texture cannot be packed
+  };
+
+  struct Bucket
+  {
+    GLint internalFormat;
+    bool compressed;
+    int width, height, levels;
+    int layers;
+    unsigned int id;
+  };
+
+  static int fullChainLevels(int width, int height)
+  {
+    return int(floor(log2(double(max(width, height))))) + 1;
+  }
+
+  // client format of an uncompressed internal format, 0 for ones that are not packed
+  static GLenum pixelFormat(GLint internalFormat, int &components)
+  {
+    switch (internalFormat)
+    {
+    case GL_RED:
+    case GL_R8:
+      components = 1;
+      return GL_RED;
+    case GL_RG:
+    case GL_RG8:
+      components = 2;
+      return GL_RG;
+    case GL_RGB:
+    case GL_RGB8:
+      components = 3;
+      return GL_RGB;
+    case GL_RGBA:
+    case GL_RGBA8:
+      components = 4;
+      return GL_RGBA;
+    }
+    components = 0;
+    return 0;
+  }
+
+  // size, format and the run of consistent levels from 0 up to GL_TEXTURE_MAX_LEVEL
+  static Source describe(unsigned int id)
+  {
+    Source source;
+    source.id = id;
+    glBindTexture(GL_TEXTURE_2D, id);
+    GLint baseLevel = 0, maxLevel = 0, compressed = 0;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &source.width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &source.height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &source.internalFormat);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    source.compressed = compressed != 0;
+    int components;
+    if (baseLevel != 0 || source.width == 0 || source.height == 0 || (!source.compressed && !pixelFormat(source.internalFormat, components)))
+      return source;
+    int levels = min(fullChainLevels(source.width, source.height), maxLevel + 1);
+    for (int level = 1; level < levels; level++)
+    {
+      GLint width = 0, height = 0;
+      glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+      glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+      if (width != max(1, source.width >> level) || height != max(1, source.height >> level))
+        levels = level;
+    }
+    source.levels = levels;
+    return source;
+  }
+
+  void allocate(Bucket &bucket)
+  {
+    glGenTextures(1, &bucket.id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bucket.id);
+    int components = 0;
+    GLenum format = pixelFormat(bucket.internalFormat, components);
+    for (int level = 0; level < bucket.levels; level++)
+    {
+      int width = max(1, bucket.width >> level), height = max(1, bucket.height >> level);
+      if (bucket.compressed)
+      {
+        // every block-compressed format here has 4x4 blocks of 8 or 16 bytes
+        size_t blockBytes = bucket.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || bucket.internalFormat == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+        size_t levelBytes = size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes * bucket.layers;
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, bucket.internalFormat, width, height, bucket.layers, 0, GLsizei(levelBytes), nullptr);
+        bytes += levelBytes;
+      }
+      else
+      {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, bucket.internalFormat, width, height, bucket.layers, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        bytes += size_t(width) * height * components * bucket.layers;
+      }
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, bucket.levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    arrays.push_back(bucket.id);
+    layers += bucket.layers;
+  }
+
+  void copyLayer(const Bucket &bucket, const Source &source, int layer)
+  {
+    if (glCopyImageSubData)
+    {
+      for (int level = 0; level < bucket.levels; level++)
+        glCopyImageSubData(source.id, GL_TEXTURE_2D, level, 0, 0, 0, bucket.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                           max(1, bucket.width >> level), max(1, bucket.height >> level), 1);
+      return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, source.id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bucket.id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    int components = 0;
+    GLenum format = pixelFormat(bucket.internalFormat, components);
+    vector<unsigned char> pixels;
+    for (int level = 0; level < bucket.levels; level++)
+    {
+      int width = max(1, bucket.width >> level), height = max(1, bucket.height >> level);
+      if (bucket.compressed)
+      {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        pixels.resize(size_t(size));
+        glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, bucket.internalFormat, size, pixels.data());
+      }
+      else
+      {
+        pixels.resize(size_t(width) * height * components);
+        glGetTexImage(GL_TEXTURE_2D, level, format, GL_UNSIGNED_BYTE, pixels.data());
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels.data());
+      }
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  // scales level 0 to the bucket's size and uploads a new chain built from it
+  void resampleLayer(const Bucket &bucket, const Source &source, int layer, const MipOptions &options)
+  {
+    int components = 0;
+    GLenum format = pixelFormat(bucket.internalFormat, components);
+    vector<unsigned char> pixels(size_t(source.width) * source.height * components);
+    glBindTexture(GL_TEXTURE_2D, source.id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    vector<unsigned char> scaled(size_t(bucket.width) * bucket.height * components);
+    for (int y = 0; y < bucket.height; y++)
+    {
+      float sy = max(0.0f, (y + 0.5f) * source.height / bucket.height - 0.5f);
+      int y0 = min(int(sy), source.height - 1), y1 = min(y0 + 1, source.height - 1);
+      float fy = sy - y0;
+      for (int x = 0; x < bucket.width; x++)
+      {
+        float sx = max(0.0f, (x + 0.5f) * source.width / bucket.width - 0.5f);
+        int x0 = min(int(sx), source.width - 1), x1 = min(x0 + 1, source.width - 1);
+        float fx = sx - x0;
+        for (int c = 0; c < components; c++)
+        {
+          auto at = [&](int px, int py) { return float(pixels[(size_t(py) * source.width + px) * components + c]); };
+          float top = at(x0, y0) + (at(x1, y0) - at(x0, y0)) * fx;
+          float bottom = at(x0, y1) + (at(x1, y1) - at(x0, y1)) * fx;
+          scaled[(size_t(y) * bucket.width + x) * components + c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+        }
+      }
+    }
+
+    MipChain chain = MipBuilder::Instance().Build(scaled.data(), bucket.width, bucket.height, components, options);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bucket.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < bucket.levels && level < int(chain.levels.size()); level++)
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, chain.LevelWidth(level), chain.LevelHeight(level), 1, format, GL_UNSIGNED_BYTE,
+                      chain.levels[level].data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    resampled++;
+  }
+};
+
+#endif
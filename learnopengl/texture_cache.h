@@ -0,0 +1,184 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "file_map.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Process-wide cache of GL textures shared by every loader (TextureFromFile, loadTexture,
+ * loadCubemap), so an image referenced by several models is decoded and uploaded once.
+ *
+ * Entries are keyed by canonical absolute path, or by a hash of the file content when
+ * KeyByContent is set (catches identical images stored under different names). Every
+ * Acquire of a texture must be paired with a Release of its id; the GL texture is
+ * deleted when the last reference goes away. GL thread only.
+ */
+class TextureCache
+{
+public:
+  bool KeyByContent = false;
+
+  // counters since startup; bytesSaved is GPU memory that cache hits did not allocate again
+  unsigned int hits = 0;
+  unsigned int misses = 0;
+  size_t bytesLoaded = 0;
+  size_t bytesSaved = 0;
+
+  // called with each texture Release is about to delete, for loaders keeping per-texture state
+  vector<function<void(unsigned int id)>> OnDelete;
+
+  static TextureCache &Instance()
+  {
+    static TextureCache cache;
+    return cache;
+  }
+
+  /*
+   * returns the texture for the given source files, calling load on a miss. load creates
+   * the GL texture, stores its GPU size in bytes and returns its id (0 on failure, which
+   * is not cached). Cubemaps pass their six faces as one key. srgb is part of the key, since
+   * it changes how the mips are filtered and which block format is cached.
+   */
+  unsigned int Acquire(const vector<string> &files, const function<unsigned int(size_t &bytes)> &load, bool srgb = false)
+  {
+    string key = makeKey(files, srgb);
+    auto found = entries.find(key);
+    if (found != entries.end())
+    {
+      Entry &entry = found->second;
+      entry.refCount++;
+      hits++;
+      bytesSaved += entry.bytes;
+      return entry.id;
+    }
+
+    misses++;
+    size_t bytes = 0;
+    unsigned int id = load(bytes);
+    if (id == 0)
+      return 0;
+    entries[key] = Entry{id, bytes, 1};
+    keysById[id] = key;
+    bytesLoaded += bytes;
+    return id;
+  }
+
+  unsigned int Acquire(const string &file, const function<unsigned int(size_t &bytes)> &load, bool srgb = false)
+  {
+    return Acquire(vector<string>{file}, load, srgb);
+  }
+
+  // drops one reference; the texture is deleted once nothing references it
+  void Release(unsigned int id)
+  {
+    auto key = keysById.find(id);
+    if (key == keysById.end())
+      return;
+    auto entry = entries.find(key->second);
+    if (--entry->second.refCount == 0)
+    {
+      for (const auto &onDelete : OnDelete)
+        onDelete(id);
+      glDeleteTextures(1, &id);
+      entries.erase(entry);
+      keysById.erase(key);
+    }
+  }
+
+  size_t ResidentBytes() const
+  {
+    size_t total = 0;
+    for (const auto &entry : entries)
+      total += entry.second.bytes;
+    return total;
+  }
+
+  void PrintStats() const
+  {
+    printf("TEXTURE_CACHE:: %zu textures, %u hits, %u misses, %.1f MB loaded, %.1f MB resident, %.1f MB saved\n",
+           entries.size(), hits, misses, bytesLoaded / 1048576.0, ResidentBytes() / 1048576.0, bytesSaved / 1048576.0);
+  }
+
+private:
+  struct Entry
+  {
+    unsigned int id;
+    size_t bytes;
+    unsigned int refCount;
+  };
+
+  unordered_map<string, Entry> entries;
+  unordered_map<unsigned int, string> keysById;
+
+  TextureCache() {}
+
+  string makeKey(const vector<string> &files, bool srgb) const
+  {
+    string key;
+    for (const string &file : files)
+    {
+      if (!key.empty())
+        key += '|';
+      if (KeyByContent)
+      {
+        uint64_t hash = HashFile(file);
+        if (hash != 0)
+        {
+          char hex[17];
+          snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+          key += hex;
+          continue;
+        }
+      }
+      key += canonicalPath(file);
+    }
+    if (srgb)
+      key += "|srgb";
+    return key;
+  }
+
+  static string canonicalPath(const string &file)
+  {
+    error_code error;
+    filesystem::path path = filesystem::weakly_canonical(filesystem::absolute(file, error), error);
+    return error ? file : path.string();
+  }
+};
+
+// estimated GPU size of a 2D texture, including the mip chain when present
+inline size_t TextureBytes(int width, int height, int components, bool mipmapped)
+{
+  size_t bytes = size_t(width) * height * components;
+  return mipmapped ? bytes * 4 / 3 : bytes;
+}
+
+// pixel format of an 8-bit image with 1-4 components as stb_image decodes them; 0 for any other count
+inline GLenum TextureFormat(int components)
+{
+  switch (components)
+  {
+  case 1:
+    return GL_RED;
+  case 2:
+    return GL_RG;
+  case 3:
+    return GL_RGB;
+  case 4:
+    return GL_RGBA;
+  default:
+    return 0;
+  }
+}
+
+#endif
@@ -0,0 +1,700 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include "file_map.h"
+#include "gl_extensions.h"
+#include "mip_builder.h"
+#include "profiler.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// stb_image.h must be included before this header (texture_loader.h does so)
+
+/*
+ * Block-compressed textures with a disk cache. The first load of an image transcodes it into a
+ * BCn format with a full mip chain and writes <image>.dds next to it (arm_dif.png ->
+ * arm_dif.png.dds); later loads read the DDS and upload every level with glCompressedTexImage2D,
+ * skipping both the PNG/JPG decode and glGenerateMipmap. Mips come from the MipBuilder.
+ *
+ *   BC5  normal maps (*_ddn, *_normal, *_nrm): X and Y only, shaders rebuild Z
+ *   BC4  single-channel images
+ *   BC3  colour with alpha
+ *   BC1  opaque colour
+ *
+ * BC1/BC3 need EXT_texture_compression_s3tc (all desktop drivers); without it colour images
+ * are not compressed and the caller keeps its uncompressed path. BC4/BC5 are core since GL 3.0.
+ */
+enum class BlockFormat
+{
+  BC1,
+  BC3,
+  BC4,
+  BC5
+};
+
+inline unsigned int BlockBytes(BlockFormat format)
+{
+  return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+inline GLenum BlockGLFormat(BlockFormat format)
+{
+  switch (format)
+  {
+  case BlockFormat::BC1:
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case BlockFormat::BC3:
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case BlockFormat::BC4:
+    return GL_COMPRESSED_RED_RGTC1;
+  default:
+    return GL_COMPRESSED_RG_RGTC2;
+  }
+}
+
+inline const char *BlockFormatName(BlockFormat format)
+{
+  const char *names[] = {"BC1", "BC3", "BC4", "BC5"};
+  return names[int(format)];
+}
+
+struct CompressedImage
+{
+  BlockFormat format = BlockFormat::BC1;
+  int width = 0, height = 0;
+  vector<vector<unsigned char>> levels; // level 0 first, each ceil(w / 4) * ceil(h / 4) blocks
+
+  size_t Bytes() const
+  {
+    size_t total = 0;
+    for (const vector<unsigned char> &level : levels)
+      total += level.size();
+    return total;
+  }
+};
+
+namespace bc_detail
+{
+inline uint16_t pack565(const float color[3])
+{
+  int r = int(clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+  int g = int(clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+  int b = int(clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+inline void unpack565(uint16_t packed, float color[3])
+{
+  int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = float((r << 3) | (r >> 2));
+  color[1] = float((g << 2) | (g >> 4));
+  color[2] = float((b << 3) | (b >> 2));
+}
+
+// nearest entry of the 4-colour palette of c0, c1 for every pixel; returns the squared error
+inline float bc1Indices(const float pixels[16][3], uint16_t c0, uint16_t c1, uint32_t &indices)
+{
+  float palette[4][3];
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for (int k = 0; k < 3; k++)
+  {
+    palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+    palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+  }
+  float error = 0.0f;
+  indices = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    float best = 1e30f;
+    uint32_t bestIndex = 0;
+    for (uint32_t p = 0; p < 4; p++)
+    {
+      float dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+      float distance = dr * dr + dg * dg + db * db;
+      if (distance < best)
+      {
+        best = distance;
+        bestIndex = p;
+      }
+    }
+    indices |= bestIndex << (2 * i);
+    error += best;
+  }
+  return error;
+}
+
+/*
+ * endpoints from the extremes of the pixels along their principal axis, then one least-squares
+ * refit of the endpoints to the chosen indices. Always 4-colour mode, so the block also
+ * decodes correctly as the colour half of BC3.
+ */
+inline void encodeBC1(const unsigned char rgba[16][4], unsigned char *out)
+{
+  float pixels[16][3];
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  float lo[3] = {255.0f, 255.0f, 255.0f}, hi[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++)
+    for (int k = 0; k < 3; k++)
+    {
+      pixels[i][k] = rgba[i][k];
+      mean[k] += pixels[i][k] / 16.0f;
+      lo[k] = min(lo[k], pixels[i][k]);
+      hi[k] = max(hi[k], pixels[i][k]);
+    }
+
+  float covariance[3][3] = {};
+  for (int i = 0; i < 16; i++)
+    for (int a = 0; a < 3; a++)
+      for (int b = 0; b < 3; b++)
+        covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+
+  // power iteration, seeded with the bounding box diagonal
+  float axis[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+  for (int iteration = 0; iteration < 8; iteration++)
+  {
+    float next[3];
+    for (int a = 0; a < 3; a++)
+      next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+    float length = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (length < 1e-6f)
+      break;
+    for (int a = 0; a < 3; a++)
+      axis[a] = next[a] / length;
+  }
+  float axisLength = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  if (axisLength > 1e-6f)
+    for (int a = 0; a < 3; a++)
+      axis[a] /= axisLength;
+
+  float minT = 0.0f, maxT = 0.0f;
+  for (int i = 0; i < 16; i++)
+  {
+    float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+    minT = min(minT, t);
+    maxT = max(maxT, t);
+  }
+  float end0[3], end1[3];
+  for (int k = 0; k < 3; k++)
+  {
+    end0[k] = mean[k] + axis[k] * maxT;
+    end1[k] = mean[k] + axis[k] * minT;
+  }
+  uint16_t c0 = pack565(end0), c1 = pack565(end1);
+  uint32_t indices;
+  float error = bc1Indices(pixels, c0, c1, indices);
+
+  // least-squares endpoints for these indices: minimise sum |alpha a + (1 - alpha) b - x|^2
+  const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+  float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = {0.0f, 0.0f, 0.0f}, bx[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++)
+  {
+    float alpha = weights[(indices >> (2 * i)) & 3], beta = 1.0f - alpha;
+    aa += alpha * alpha;
+    bb += beta * beta;
+    ab += alpha * beta;
+    for (int k = 0; k < 3; k++)
+    {
+      ax[k] += alpha * pixels[i][k];
+      bx[k] += beta * pixels[i][k];
+    }
+  }
+  float determinant = aa * bb - ab * ab;
+  if (fabs(determinant) > 1e-6f)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      end0[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+      end1[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+    }
+    uint16_t r0 = pack565(end0), r1 = pack565(end1);
+    uint32_t refined;
+    float refinedError = bc1Indices(pixels, r0, r1, refined);
+    if (refinedError < error)
+    {
+      c0 = r0;
+      c1 = r1;
+      indices = refined;
+    }
+  }
+
+  // c0 > c1 selects 4-colour mode; swapping the endpoints swaps index pairs 0/1 and 2/3
+  if (c0 < c1)
+  {
+    swap(c0, c1);
+    indices ^= 0x55555555u;
+  }
+  else if (c0 == c1)
+    indices = 0; // index 3 would be transparent black in 3-colour mode
+
+  out[0] = uint8_t(c0);
+  out[1] = uint8_t(c0 >> 8);
+  out[2] = uint8_t(c1);
+  out[3] = uint8_t(c1 >> 8);
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = uint8_t(indices >> (8 * i));
+}
+
+// 8-value mode between the block's min and max
+inline void encodeBC4(const unsigned char values[16], unsigned char *out)
+{
+  unsigned char lo = 255, hi = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    lo = min(lo, values[i]);
+    hi = max(hi, values[i]);
+  }
+  out[0] = hi;
+  out[1] = lo;
+  uint64_t bits = 0;
+  if (hi > lo)
+  {
+    float palette[8] = {float(hi), float(lo)};
+    for (int p = 2; p < 8; p++)
+      palette[p] = ((8 - p) * float(hi) + (p - 1) * float(lo)) / 7.0f;
+    for (int i = 0; i < 16; i++)
+    {
+      uint64_t bestIndex = 0;
+      float best = 1e30f;
+      for (int p = 0; p < 8; p++)
+      {
+        float distance = fabs(values[i] - palette[p]);
+        if (distance < best)
+        {
+          best = distance;
+          bestIndex = uint64_t(p);
+        }
+      }
+      bits |= bestIndex << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = uint8_t(bits >> (8 * i));
+}
+
+inline void encodeBlock(BlockFormat format, const unsigned char rgba[16][4], unsigned char *out)
+{
+  unsigned char channel[16];
+  switch (format)
+  {
+  case BlockFormat::BC1:
+    encodeBC1(rgba, out);
+    break;
+  case BlockFormat::BC3:
+    for (int i = 0; i < 16; i++)
+      channel[i] = rgba[i][3];
+    encodeBC4(channel, out); // BC3 alpha blocks are BC4 blocks
+    encodeBC1(rgba, out + 8);
+    break;
+  case BlockFormat::BC4:
+    for (int i = 0; i < 16; i++)
+      channel[i] = rgba[i][0];
+    encodeBC4(channel, out);
+    break;
+  case BlockFormat::BC5:
+    for (int c = 0; c < 2; c++)
+    {
+      for (int i = 0; i < 16; i++)
+        channel[i] = rgba[i][c];
+      encodeBC4(channel, out + 8 * c);
+    }
+    break;
+  }
+}
+
+// one mip level of width x height RGBA8 pixels; blocks past the edge repeat the last row/column
+inline vector<unsigned char> encodeLevel(BlockFormat format, const unsigned char *rgba, int width, int height)
+{
+  int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  unsigned int blockBytes = BlockBytes(format);
+  vector<unsigned char> blocks(size_t(blocksX) * blocksY * blockBytes);
+  WorkerPool().ParallelFor(size_t(blocksY), [&](size_t by)
+  {
+    unsigned char block[16][4];
+    for (int bx = 0; bx < blocksX; bx++)
+    {
+      for (int i = 0; i < 16; i++)
+      {
+        int x = min(bx * 4 + i % 4, width - 1), y = min(int(by) * 4 + i / 4, height - 1);
+        memcpy(block[i], rgba + (size_t(y) * width + x) * 4, 4);
+      }
+      encodeBlock(format, block, &blocks[(by * blocksX + bx) * blockBytes]);
+    }
+  });
+  return blocks;
+}
+
+} // namespace bc_detail
+
+// encodes RGBA8 pixels, plus every mip level down to 1x1 from the MipBuilder when mipmapped
+inline CompressedImage CompressImage(const unsigned char *rgba, int width, int height, BlockFormat format, bool mipmapped,
+                                     MipOptions options = MipOptions())
+{
+  PROFILE_SCOPE("CompressImage");
+  CompressedImage image;
+  image.format = format;
+  image.width = width;
+  image.height = height;
+  if (!mipmapped)
+  {
+    image.levels.push_back(bc_detail::encodeLevel(format, rgba, width, height));
+    return image;
+  }
+  options.normalMap = format == BlockFormat::BC5;
+  MipChain chain = MipBuilder::Instance().Build(rgba, width, height, 4, options);
+  for (size_t level = 0; level < chain.levels.size(); level++)
+    image.levels.push_back(bc_detail::encodeLevel(format, chain.levels[level].data(), chain.LevelWidth(level), chain.LevelHeight(level)));
+  return image;
+}
+
+// BC5 for normal maps by file name, BC4 for single-channel images, BC3 when any alpha < 255, else BC1
+inline BlockFormat ChooseBlockFormat(const string &path, const unsigned char *rgba, int width, int height, int components)
+{
+  string name = path.substr(path.find_last_of("/\\") + 1);
+  transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return char(tolower(c)); });
+  if (components >= 3 && (name.find("_ddn") != string::npos || name.find("_normal") != string::npos || name.find("_nrm") != string::npos))
+    return BlockFormat::BC5;
+  if (components == 1)
+    return BlockFormat::BC4;
+  if (components == 2 || components == 4)
+    for (size_t i = 0; i < size_t(width) * height; i++)
+      if (rgba[i * 4 + 3] != 255)
+        return BlockFormat::BC3;
+  return BlockFormat::BC1;
+}
+
+/*
+ * DDS files with the legacy FourCCs (DXT1, DXT5, ATI1, ATI2), readable by common texture tools.
+ * The header's reserved words hold {'LOGL', version, source hash low, source hash high, flags};
+ * a file whose tag does not match the source image and load options is a cache miss.
+ */
+namespace dds_detail
+{
+const uint32_t MAGIC = 0x20534444; // "DDS "
+const uint32_t CACHE_VERSION = 2;
+const uint32_t FLAG_MIPMAPPED = 1;
+const uint32_t FLAG_FLIPPED = 2; // decoded with stbi_set_flip_vertically_on_load(true), see FlipVertically
+const uint32_t FLAG_SRGB = 4;    // mips filtered in linear light
+const uint32_t FLAG_CLAMP = 8;   // mips filtered with clamped edges
+const uint32_t FILTER_SHIFT = 8; // MipFilter of the mips
+
+struct PixelFormat
+{
+  uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+};
+
+struct Header
+{
+  uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+  uint32_t reserved1[11];
+  PixelFormat pixelFormat;
+  uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+static_assert(sizeof(Header) == 124, "DDS header is 124 bytes");
+
+constexpr uint32_t fourCC(char a, char b, char c, char d)
+{
+  return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+const uint32_t FOURCCS[4] = {fourCC('D', 'X', 'T', '1'), fourCC('D', 'X', 'T', '5'), fourCC('A', 'T', 'I', '1'), fourCC('A', 'T', 'I', '2')};
+const uint32_t TAG = fourCC('L', 'O', 'G', 'L');
+
+inline size_t levelBytes(BlockFormat format, int width, int height)
+{
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+} // namespace dds_detail
+
+inline bool WriteDDS(const string &path, const CompressedImage &image, uint64_t sourceHash, uint32_t flags)
+{
+  using namespace dds_detail;
+  Header header = {};
+  header.size = sizeof(Header);
+  header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+  header.height = uint32_t(image.height);
+  header.width = uint32_t(image.width);
+  header.pitchOrLinearSize = uint32_t(image.levels[0].size());
+  header.mipMapCount = uint32_t(image.levels.size());
+  header.reserved1[0] = TAG;
+  header.reserved1[1] = CACHE_VERSION;
+  header.reserved1[2] = uint32_t(sourceHash);
+  header.reserved1[3] = uint32_t(sourceHash >> 32);
+  header.reserved1[4] = flags;
+  header.pixelFormat.size = sizeof(PixelFormat);
+  header.pixelFormat.flags = 0x4; // FourCC
+  header.pixelFormat.fourCC = FOURCCS[int(image.format)];
+  header.caps = 0x1000 | (image.levels.size() > 1 ? 0x400000 | 0x8 : 0); // texture, mipmap, complex
+
+  // write to a temporary file first so a crash never leaves a truncated cache behind
+  string tempPath = path + ".tmp";
+  ofstream out(tempPath, ios::binary | ios::trunc);
+  if (!out)
+    return false;
+  out.write(reinterpret_cast<const char *>(&MAGIC), sizeof(MAGIC));
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const vector<unsigned char> &level : image.levels)
+    out.write(reinterpret_cast<const char *>(level.data()), level.size());
+  out.close();
+  if (!out || rename(tempPath.c_str(), path.c_str()) != 0)
+  {
+    remove(tempPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+// false when the file is missing, not one of ours, or written for other source bytes or flags;
+// levels before firstLevel are left empty (MipStreamer reads only the ones it is missing)
+inline bool ReadDDS(const string &path, uint64_t sourceHash, uint32_t flags, CompressedImage &image, uint32_t firstLevel = 0)
+{
+  using namespace dds_detail;
+  MappedFile file;
+  if (!file.open(path) || file.size < sizeof(MAGIC) + sizeof(Header))
+    return false;
+  uint32_t magic;
+  Header header;
+  memcpy(&magic, file.data, sizeof(magic));
+  memcpy(&header, file.data + sizeof(magic), sizeof(header));
+  if (magic != MAGIC || header.reserved1[0] != TAG || header.reserved1[1] != CACHE_VERSION || header.reserved1[2] != uint32_t(sourceHash) ||
+      header.reserved1[3] != uint32_t(sourceHash >> 32) || header.reserved1[4] != flags)
+    return false;
+
+  const uint32_t *format = find(begin(FOURCCS), end(FOURCCS), header.pixelFormat.fourCC);
+  if (format == end(FOURCCS) || header.width == 0 || header.height == 0 || header.mipMapCount == 0 || header.mipMapCount > 32)
+    return false;
+  image.format = BlockFormat(format - begin(FOURCCS));
+  image.width = int(header.width);
+  image.height = int(header.height);
+  image.levels.clear();
+  size_t offset = sizeof(magic) + sizeof(header);
+  int width = image.width, height = image.height;
+  for (uint32_t level = 0; level < header.mipMapCount; level++)
+  {
+    size_t bytes = levelBytes(image.format, width, height);
+    if (offset + bytes > file.size)
+    {
+      cout << "WARNING::TEXTURE_COMPRESSION:: corrupt cache file ignored: " << path << endl;
+      return false;
+    }
+    if (level >= firstLevel)
+      image.levels.emplace_back(file.data + offset, file.data + offset + bytes);
+    else
+      image.levels.emplace_back();
+    offset += bytes;
+    width = max(1, width / 2);
+    height = max(1, height / 2);
+  }
+  return true;
+}
+
+/*
+ * Loader used by TextureFromFile, loadTexture and loadCubemap when Enabled. Each Load* returns 0
+ * when the image cannot be compressed here (unreadable, or S3TC missing for a colour image),
+ * and the caller falls back to its uncompressed path. GL thread only, which also covers the
+ * counters: MipStreamer calls LoadImage from its own Load, never from a WorkerPool job. The
+ * thread that first uses the instance owns it, and loads from any other thread assert.
+ */
+class TextureCompression
+{
+public:
+  bool Enabled = false;
+  bool WriteCache = true; // store transcoded images as <image>.dds; off only re-encodes in memory
+  // set along with stbi_set_flip_vertically_on_load(true), which has no getter; tags the .dds files
+  bool FlipVertically = false;
+
+  // counters since startup
+  unsigned int textures = 0;    // images uploaded compressed (a cubemap counts six)
+  unsigned int transcoded = 0;  // of those, encoded this run instead of read from a .dds
+  size_t compressedBytes = 0;   // their GPU size
+  size_t uncompressedBytes = 0; // their GPU size as 8-bit RGB(A), what the uncompressed path allocates
+  double loadMilliseconds = 0.0;
+  unsigned int formatCounts[4] = {0, 0, 0, 0};
+
+  static TextureCompression &Instance()
+  {
+    static TextureCompression compression;
+    return compression;
+  }
+
+  bool Supported(BlockFormat format) const
+  {
+    if (format == BlockFormat::BC4 || format == BlockFormat::BC5)
+      return true;
+    static const bool s3tc = HasGLExtension("GL_EXT_texture_compression_s3tc");
+    return s3tc;
+  }
+
+  // 2D texture with mips, repeat wrapping and trilinear filtering, like the uncompressed loaders;
+  // srgb filters the mips of colour images in linear light
+  unsigned int LoadTexture2D(const string &path, size_t &bytes, bool srgb = false)
+  {
+    PROFILE_SCOPE("LoadCompressedTexture");
+    auto start = chrono::steady_clock::now();
+    CompressedImage image;
+    MipOptions options;
+    options.srgb = srgb;
+    if (!load(path, true, options, image))
+      return 0;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    upload(GL_TEXTURE_2D, image);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    bytes = image.Bytes();
+    loadMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return textureID;
+  }
+
+  // cubemap with mips filtered per face in linear light; all six faces must compress or none is used
+  unsigned int LoadCubemap(const vector<string> &faces, size_t &bytes)
+  {
+    PROFILE_SCOPE("LoadCompressedCubemap");
+    auto start = chrono::steady_clock::now();
+    vector<CompressedImage> images(faces.size());
+    MipOptions options;
+    options.srgb = true;
+    options.wrap = false;
+    for (size_t i = 0; i < faces.size(); i++)
+      if (!load(faces[i], true, options, images[i]))
+        return 0;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    for (size_t i = 0; i < images.size(); i++)
+    {
+      upload(GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i), images[i]);
+      bytes += images[i].Bytes();
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, GLint(images[0].levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    loadMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return textureID;
+  }
+
+  /*
+   * the mipmapped image LoadTexture2D would upload, without creating a texture. sourceHash and
+   * cacheFlags are what ReadDDS needs to read levels of <path>.dds again later; the .dds only
+   * exists when WriteCache is set.
+   */
+  bool LoadImage(const string &path, const MipOptions &options, CompressedImage &image, uint64_t &sourceHash, uint32_t &cacheFlags)
+  {
+    return load(path, true, options, image, &sourceHash, &cacheFlags);
+  }
+
+  void ResetStats()
+  {
+    textures = transcoded = 0;
+    compressedBytes = uncompressedBytes = 0;
+    loadMilliseconds = 0.0;
+    fill(begin(formatCounts), end(formatCounts), 0u);
+  }
+
+  void PrintStats() const
+  {
+    printf("TEXTURE_COMPRESSION:: %u textures (%u transcoded; BC1 %u, BC3 %u, BC4 %u, BC5 %u), %.1f MB uncompressed -> %.1f MB (%.1fx), "
+           "load %.1f ms\n",
+           textures, transcoded, formatCounts[0], formatCounts[1], formatCounts[2], formatCounts[3], uncompressedBytes / 1048576.0,
+           compressedBytes / 1048576.0, compressedBytes ? double(uncompressedBytes) / compressedBytes : 0.0, loadMilliseconds);
+  }
+
+private:
+  thread::id owner = this_thread::get_id();
+
+  TextureCompression() {}
+
+  // reads <path>.dds, or decodes and transcodes the image and writes it
+  bool load(const string &path, bool mipmapped, const MipOptions &options, CompressedImage &image, uint64_t *hashOut = nullptr,
+            uint32_t *flagsOut = nullptr)
+  {
+    assert(this_thread::get_id() == owner && "TextureCompression used off the GL thread");
+    uint64_t sourceHash = HashFile(path);
+    if (sourceHash == 0)
+      return false;
+    uint32_t flags = FlipVertically ? dds_detail::FLAG_FLIPPED : 0;
+    if (mipmapped)
+      flags |= dds_detail::FLAG_MIPMAPPED | (options.srgb ? dds_detail::FLAG_SRGB : 0) | (options.wrap ? 0 : dds_detail::FLAG_CLAMP) |
+               uint32_t(MipBuilder::Instance().Filter) << dds_detail::FILTER_SHIFT;
+    if (hashOut)
+      *hashOut = sourceHash;
+    if (flagsOut)
+      *flagsOut = flags;
+    string cachePath = path + ".dds";
+    bool cached = ReadDDS(cachePath, sourceHash, flags, image);
+    int components = 0;
+    if (!cached)
+    {
+      int width, height;
+      unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &components, 4);
+      if (!pixels)
+        return false;
+      BlockFormat format = ChooseBlockFormat(path, pixels, width, height, components);
+      if (!Supported(format))
+      {
+        stbi_image_free(pixels);
+        return false;
+      }
+      image = CompressImage(pixels, width, height, format, mipmapped, options);
+      stbi_image_free(pixels);
+      if (WriteCache && !WriteDDS(cachePath, image, sourceHash, flags))
+        cout << "WARNING::TEXTURE_COMPRESSION:: cannot write " << cachePath << endl;
+      transcoded++;
+    }
+    else if (!Supported(image.format))
+      return false;
+
+    // what the uncompressed loaders would have allocated for the same image
+    if (components == 0)
+    {
+      int width, height;
+      if (!stbi_info(path.c_str(), &width, &height, &components))
+        components = 4;
+    }
+    textures++;
+    formatCounts[int(image.format)]++;
+    compressedBytes += image.Bytes();
+    uncompressedBytes += TextureBytes(image.width, image.height, components, mipmapped);
+    return true;
+  }
+
+  static void upload(GLenum target, const CompressedImage &image)
+  {
+    GLenum format = BlockGLFormat(image.format);
+    int width = image.width, height = image.height;
+    for (size_t level = 0; level < image.levels.size(); level++)
+    {
+      glCompressedTexImage2D(target, GLint(level), format, width, height, 0, GLsizei(image.levels[level].size()), image.levels[level].data());
+      width = max(1, width / 2);
+      height = max(1, height / 2);
+    }
+  }
+};
+
+#endif
@@ -14,23 +14,73 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "mip_builder.h"
+#include "profiler.h"
+#include "texture_cache.h"
+#include "texture_compression.h"
+#include "texture_streamer.h"
+
 using namespace std;
 
-// utility function for loading cube map from file
-// -----------------------------------------------
+unsigned int loadCubemapUncached(const vector<string> &faces, size_t &bytes);
+unsigned int loadTextureUncached(char const *path, size_t &bytes, bool gamma = false);
+
+// utility function for loading cube map from file, shared through the TextureCache
+// --------------------------------------------------------------------------------
 unsigned int loadCubemap(vector<string> faces)
 {
+  return TextureCache::Instance().Acquire(faces, [&](size_t &bytes) { return loadCubemapUncached(faces, bytes); });
+}
+
+unsigned int loadCubemapUncached(const vector<string> &faces, size_t &bytes)
+{
+  PROFILE_SCOPE("loadCubemap");
+  if (TextureCompression::Instance().Enabled)
+  {
+    unsigned int compressed = TextureCompression::Instance().LoadCubemap(faces, bytes);
+    if (compressed)
+      return compressed;
+  }
+
   unsigned int textureID;
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
   int width, height, nrComponents;
+  // faces are decoded and their mips built on the WorkerPool (the GL thread takes part)
+  vector<MipChain> chains(MipBuilder::Instance().Enabled ? faces.size() : 0);
+  if (!chains.empty())
+    WorkerPool().ParallelFor(faces.size(), [&](size_t i)
+    {
+      int faceWidth, faceHeight, faceComponents;
+      unsigned char *data = stbi_load(faces[i].c_str(), &faceWidth, &faceHeight, &faceComponents, 3);
+      if (!data)
+        return;
+      MipOptions options;
+      options.srgb = true;
+      options.wrap = false;
+      options.parallel = false;
+      chains[i] = MipBuilder::Instance().Build(data, faceWidth, faceHeight, 3, options);
+      stbi_image_free(data);
+    });
   for (unsigned int i = 0; i < faces.size(); i++)
   {
+    if (!chains.empty())
+    {
+      if (!chains[i].levels.empty())
+      {
+        MipBuilder::Upload(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, chains[i], GL_RGB, GL_RGB);
+        bytes += TextureBytes(chains[i].width, chains[i].height, 3, true);
+      }
+      else
+        cout << "Cubemap texture load failed" << endl;
+      continue;
+    }
     unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
     if (data)
     {
       glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+      bytes += TextureBytes(width, height, 3, true);
     }
     else
     {
@@ -38,9 +88,12 @@ unsigned int loadCubemap(vector<string> faces)
     }
     stbi_image_free(data);
   }
+  // without mips the minified skybox aliases
+  if (chains.empty())
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
   // texture params setting
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -49,40 +102,70 @@ unsigned int loadCubemap(vector<string> faces)
   return textureID;
 };
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const *path)
+// utility function for loading a 2D texture from file, shared through the TextureCache;
+// gamma marks sRGB colour, whose CPU-built mips are filtered in linear light
+// ------------------------------------------------------------------------------------
+unsigned int loadTexture(char const *path, bool gamma = false)
 {
+  return TextureCache::Instance().Acquire(path, [&](size_t &bytes) { return loadTextureUncached(path, bytes, gamma); }, gamma);
+}
+
+unsigned int loadTextureUncached(char const *path, size_t &bytes, bool gamma)
+{
+  PROFILE_SCOPE("loadTexture");
+  int width, height, nrComponents;
+  if (TextureCompression::Instance().Enabled)
+  {
+    // a .dds read is cheap enough to stay synchronous even when streaming is on
+    unsigned int compressed = TextureCompression::Instance().LoadTexture2D(path, bytes, gamma);
+    if (compressed)
+      return compressed;
+  }
+  if (TextureStreamer::Instance().Enabled)
+  {
+    if (stbi_info(path, &width, &height, &nrComponents))
+      bytes = TextureBytes(width, height, nrComponents, true);
+    return TextureStreamer::Instance().LoadAsync(path, gamma);
+  }
+
   unsigned int textureID;
   glGenTextures(1, &textureID);
 
-  int width, height, nrComponents;
   unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-  if (data)
+  // 0 when stb_image failed or the image has no matching GL format; both are load failures
+  GLenum format = data ? TextureFormat(nrComponents) : 0;
+  if (format)
   {
-    GLenum format;
-    if (nrComponents == 1)
-      format = GL_RED;
-    else if (nrComponents == 3)
-      format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
-
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    if (MipBuilder::Instance().Enabled)
+    {
+      MipOptions options;
+      options.srgb = gamma;
+      MipBuilder::Upload(GL_TEXTURE_2D, MipBuilder::Instance().Build(data, width, height, nrComponents, options), format, format);
+    }
+    else
+    {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // stb_image rows are tightly packed
+      glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    bytes = TextureBytes(width, height, nrComponents, true);
     stbi_image_free(data);
   }
   else
   {
     std::cout << "Texture failed to load at path: " << path << std::endl;
     stbi_image_free(data);
+    // 0 tells the TextureCache the load failed, so it is not cached and a later Acquire retries
+    glDeleteTextures(1, &textureID);
+    return 0;
   }
 
   return textureID;
@@ -0,0 +1,237 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "bindless.h"
+#include "mip_builder.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+// stb_image.h must be included before this header (texture_loader.h does so)
+
+/*
+ * Asynchronous 2D texture loading. LoadAsync returns a texture id right away that samples
+ * as a 1x1 placeholder; the image is decoded on the WorkerPool and Update() copies it into
+ * the texture through a pixel buffer object, at most UploadBudgetBytes per call, so a big
+ * image is spread over several frames instead of stalling one.
+ *
+ * While rows are streaming in, level 0 is allocated at full size but the texture is clamped
+ * to its last (1x1) mip level holding the placeholder colour, so it is always complete.
+ * Once every row has arrived the mips are generated and the clamp is removed.
+ */
+class TextureStreamer
+{
+public:
+  bool Enabled = false;                   // route TextureFromFile/loadTexture through LoadAsync
+  size_t UploadBudgetBytes = 8 * 1048576; // pixel bytes uploaded per Update call
+  unsigned char Placeholder[4] = {128, 128, 128, 255};
+
+  static TextureStreamer &Instance()
+  {
+    static TextureStreamer streamer;
+    return streamer;
+  }
+
+  // textures queued for decode or still uploading
+  unsigned int PendingTextures() const
+  {
+    return pending;
+  }
+
+  /*
+   * creates the texture with a placeholder and queues the file for decoding; GL thread only.
+   * With the MipBuilder enabled the worker also builds the mips (in linear light when gamma is
+   * set) and they are uploaded with the last rows instead of running glGenerateMipmap.
+   */
+  unsigned int LoadAsync(const string &filename, bool gamma = false)
+  {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, Placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    shared_ptr<Job> job = make_shared<Job>();
+    job->filename = filename;
+    job->textureID = textureID;
+    job->gamma = gamma;
+    job->buildMips = MipBuilder::Instance().Enabled;
+    memcpy(job->placeholder, Placeholder, 4);
+    pending++;
+
+    WorkerPool().Enqueue([this, job]
+    {
+      job->pixels = stbi_load(job->filename.c_str(), &job->width, &job->height, &job->components, 0);
+      if (job->pixels && job->buildMips)
+      {
+        MipOptions options;
+        options.srgb = job->gamma;
+        options.parallel = false; // already on a worker
+        job->mips = MipBuilder::Instance().Build(job->pixels, job->width, job->height, job->components, options);
+        job->mips.levels[0] = vector<unsigned char>(); // pixels still holds level 0
+      }
+      lock_guard<mutex> lock(decodedMutex);
+      decoded.push_back(job);
+    });
+    return textureID;
+  }
+
+  /*
+   * uploads decoded images within the byte budget; call once per frame on the GL thread.
+   * Returns the number of textures that became fully resident.
+   */
+  unsigned int Update()
+  {
+    unsigned int completed = 0;
+    size_t budget = UploadBudgetBytes;
+    while (budget > 0)
+    {
+      if (!current)
+      {
+        lock_guard<mutex> lock(decodedMutex);
+        if (decoded.empty())
+          break;
+        current = decoded.front();
+        decoded.pop_front();
+      }
+
+      if (!current->pixels)
+      {
+        cout << "Texture failed to load at path: " << current->filename << endl;
+        finish(false);
+        continue;
+      }
+
+      budget -= min(budget, uploadRows(*current, budget));
+      if (current->rowsUploaded == current->height)
+      {
+        finish(true);
+        completed++;
+      }
+    }
+    return completed;
+  }
+
+  // blocks until every queued texture is resident, ignoring the budget
+  void Flush()
+  {
+    size_t budget = UploadBudgetBytes;
+    UploadBudgetBytes = SIZE_MAX;
+    while (pending > 0)
+    {
+      if (Update() == 0)
+        this_thread::yield();
+    }
+    UploadBudgetBytes = budget;
+  }
+
+private:
+  struct Job
+  {
+    string filename;
+    unsigned int textureID = 0;
+    unsigned char placeholder[4];
+    unsigned char *pixels = nullptr;
+    int width = 0, height = 0, components = 0;
+    int rowsUploaded = 0;
+    int placeholderLevel = 0;
+    bool gamma = false;
+    bool buildMips = false;
+    MipChain mips; // levels above 0, level 0 streams in from pixels
+  };
+
+  atomic<unsigned int> pending{0};
+  mutex decodedMutex;
+  deque<shared_ptr<Job>> decoded;
+  shared_ptr<Job> current;
+  unsigned int pbo = 0;
+
+  TextureStreamer()
+  {
+    // a texture still uploading gets its mips and level clamp once its last row arrives
+    BindlessTextures::Instance().Busy.push_back([this](unsigned int) { return pending > 0; });
+  }
+
+  // copies as many whole rows as fit in budget (at least one); returns bytes uploaded
+  size_t uploadRows(Job &job, size_t budget)
+  {
+    GLenum format = TextureFormat(job.components);
+    size_t rowBytes = size_t(job.width) * job.components;
+    glBindTexture(GL_TEXTURE_2D, job.textureID);
+
+    if (job.rowsUploaded == 0)
+    {
+      // allocate the real image and keep sampling the placeholder from the smallest mip
+      job.placeholderLevel = int(floor(log2(double(max(job.width, job.height)))));
+      glTexImage2D(GL_TEXTURE_2D, 0, format, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+      glTexImage2D(GL_TEXTURE_2D, job.placeholderLevel, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, job.placeholder);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.placeholderLevel);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job.placeholderLevel);
+    }
+
+    int rows = int(min<size_t>(job.height - job.rowsUploaded, max<size_t>(1, budget / rowBytes)));
+    size_t bytes = rows * rowBytes;
+
+    if (pbo == 0)
+      glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW); // orphan the previous upload
+    void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped)
+    {
+      memcpy(mapped, job.pixels + job.rowsUploaded * rowBytes, bytes);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job.rowsUploaded, job.width, rows, format, GL_UNSIGNED_BYTE, (void *)0);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    job.rowsUploaded += rows;
+    return bytes;
+  }
+
+  void finish(bool uploaded)
+  {
+    if (uploaded)
+    {
+      glBindTexture(GL_TEXTURE_2D, current->textureID);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+      if (current->mips.levels.empty())
+        glGenerateMipmap(GL_TEXTURE_2D);
+      else
+      {
+        GLenum format = TextureFormat(current->components);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t level = 1; level < current->mips.levels.size(); level++)
+          glTexImage2D(GL_TEXTURE_2D, GLint(level), format, current->mips.LevelWidth(level), current->mips.LevelHeight(level), 0, format,
+                       GL_UNSIGNED_BYTE, current->mips.levels[level].data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      }
+    }
+    stbi_image_free(current->pixels);
+    current.reset();
+    pending--;
+  }
+};
+
+#endif
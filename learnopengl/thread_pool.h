@@ -0,0 +1,146 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Fixed-size pool of worker threads for CPU-side loading work (mesh conversion,
+ * image decoding). Workers never touch the GL context; anything that needs GL is
+ * handed back to the context thread by the caller.
+ */
+class ThreadPool
+{
+public:
+  ThreadPool(unsigned int threadCount = 0) : stopping(false)
+  {
+    if (threadCount == 0)
+      threadCount = max(1u, thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threadCount; i++)
+      workers.emplace_back([this] { workerLoop(); });
+  }
+
+  ~ThreadPool()
+  {
+    {
+      lock_guard<mutex> lock(queueMutex);
+      stopping = true;
+    }
+    queueCondition.notify_all();
+    for (thread &worker : workers)
+      worker.join();
+  }
+
+  unsigned int Size() const
+  {
+    return static_cast<unsigned int>(workers.size());
+  }
+
+  // queues a job to run on any worker
+  void Enqueue(function<void()> job)
+  {
+    {
+      lock_guard<mutex> lock(queueMutex);
+      jobs.push(std::move(job));
+    }
+    queueCondition.notify_one();
+  }
+
+  /*
+   * runs body(i) for every i in [0, count) and returns once all calls finished.
+   * The calling thread takes part in the work and returns as soon as every index is done;
+   * helpers that only reach the front of the queue afterwards find nothing left and return.
+   * Must not be called from one of this pool's jobs (asserted).
+   */
+  void ParallelFor(size_t count, const function<void(size_t)> &body)
+  {
+    assert(currentPool() != this && "ThreadPool::ParallelFor called from one of its own jobs");
+    if (count == 0)
+      return;
+
+    // shared with the helpers, which may outlive this call; body is only reached through a claimed index
+    struct Loop
+    {
+      atomic<size_t> next{0};
+      size_t count;
+      const function<void(size_t)> *body;
+      size_t finished = 0;
+      mutex doneMutex;
+      condition_variable doneCondition;
+    };
+    shared_ptr<Loop> loop = make_shared<Loop>();
+    loop->count = count;
+    loop->body = &body;
+    auto drain = [loop]
+    {
+      size_t finished = 0;
+      for (size_t i = loop->next++; i < loop->count; i = loop->next++, finished++)
+        (*loop->body)(i);
+      if (finished == 0)
+        return;
+      lock_guard<mutex> lock(loop->doneMutex);
+      loop->finished += finished;
+      if (loop->finished == loop->count)
+        loop->doneCondition.notify_all();
+    };
+
+    size_t helpers = min<size_t>(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; i++)
+      Enqueue(drain);
+    drain();
+
+    unique_lock<mutex> lock(loop->doneMutex);
+    loop->doneCondition.wait(lock, [&] { return loop->finished == count; });
+  }
+
+private:
+  vector<thread> workers;
+  queue<function<void()>> jobs;
+  mutex queueMutex;
+  condition_variable queueCondition;
+  bool stopping;
+
+  // the pool whose worker is running on this thread, if any
+  static const ThreadPool *&currentPool()
+  {
+    static thread_local const ThreadPool *pool = nullptr;
+    return pool;
+  }
+
+  void workerLoop()
+  {
+    currentPool() = this;
+    for (;;)
+    {
+      function<void()> job;
+      {
+        unique_lock<mutex> lock(queueMutex);
+        queueCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping && jobs.empty())
+          return;
+        job = std::move(jobs.front());
+        jobs.pop();
+      }
+      job();
+    }
+  }
+};
+
+// process-wide pool shared by the loaders
+inline ThreadPool &WorkerPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+#endif
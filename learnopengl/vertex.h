@@ -0,0 +1,171 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "material.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#define MAX_BONE_INFLUENCE 4
+
+struct Vertex
+{
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec2 TexCoords;
+  glm::vec3 Tangent;
+  glm::vec3 Bitangent;
+
+  int m_BoneIds[MAX_BONE_INFLUENCE];
+  float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+/*
+ * GPU layout for meshes without skinning, 20 bytes instead of sizeof(Vertex) = 88.
+ * Position is quantized to the mesh bounds (decoded with positionScale/positionOffset),
+ * normal and tangent are octahedral-encoded and the bitangent is rebuilt in the shader
+ * as cross(N, T) * sign, with the sign kept in the spare position component.
+ */
+struct PackedVertex
+{
+  uint16_t Position[4];  // xyz unorm in mesh bounds, w = 0 for a negative bitangent sign, 65535 otherwise
+  int16_t Normal[2];     // octahedral, snorm
+  int16_t Tangent[2];    // octahedral, snorm
+  uint16_t TexCoords[2]; // half float
+};
+
+// GPU vertex layouts; meshes of the same format share vertex array state
+enum VertexFormat
+{
+  VERTEX_FULL,   // Vertex
+  VERTEX_PACKED, // PackedVertex
+  VERTEX_FORMAT_COUNT
+};
+
+inline size_t VertexStride(VertexFormat format)
+{
+  return format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// points the attributes of the bound VAO at the bound GL_ARRAY_BUFFER
+inline void SetupVertexAttributes(VertexFormat format)
+{
+  if (format == VERTEX_PACKED)
+  {
+    /*
+     * Packed attributes keep the same locations; bitangent and bone slots stay disabled
+     */
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, Position));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, Normal));
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, TexCoords));
+
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, Tangent));
+    return;
+  }
+
+  /*
+   * Set vertex attributes
+   * Position, Normal, texture coords, tangent, bitangent, id, weight
+   */
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
+
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+
+  glEnableVertexAttribArray(5);
+  glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void *)offsetof(Vertex, m_BoneIds));
+
+  glEnableVertexAttribArray(6);
+  glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, m_Weights));
+}
+
+// octahedral mapping of a unit vector to [-1, 1]^2
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+  float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+  if (sum == 0.0f)
+    return glm::vec2(0.0f);
+  n /= sum;
+  glm::vec2 e(n.x, n.y);
+  if (n.z < 0.0f)
+  {
+    e.x = (1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+    e.y = (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return e;
+}
+
+inline bool HasBoneWeights(const vector<Vertex> &vertices)
+{
+  for (const Vertex &vertex : vertices)
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+      if (vertex.m_Weights[i] != 0.0f)
+        return true;
+  return false;
+}
+
+// quantizes vertices into the PackedVertex layout and stores the position decode terms in constants
+inline vector<PackedVertex> PackVertexData(const vector<Vertex> &vertices, MaterialConstants &constants)
+{
+  glm::vec3 minimum(0.0f), maximum(0.0f);
+  if (!vertices.empty())
+    minimum = maximum = vertices[0].Position;
+  for (const Vertex &vertex : vertices)
+  {
+    minimum = glm::min(minimum, vertex.Position);
+    maximum = glm::max(maximum, vertex.Position);
+  }
+  glm::vec3 positionScale = maximum - minimum;
+  constants.positionScale = glm::vec4(positionScale, 1.0f);
+  constants.positionOffset = glm::vec4(minimum, 0.0f);
+  glm::vec3 inverseScale;
+  for (int c = 0; c < 3; c++)
+    inverseScale[c] = positionScale[c] > 0.0f ? 1.0f / positionScale[c] : 0.0f;
+
+  vector<PackedVertex> result(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    const Vertex &vertex = vertices[i];
+    PackedVertex &out = result[i];
+    glm::vec3 position = (vertex.Position - minimum) * inverseScale;
+    float sign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? 0.0f : 1.0f;
+    for (int c = 0; c < 3; c++)
+      out.Position[c] = glm::packUnorm1x16(position[c]);
+    out.Position[3] = glm::packUnorm1x16(sign);
+
+    glm::vec2 normal = octEncode(vertex.Normal);
+    glm::vec2 tangent = octEncode(vertex.Tangent);
+    for (int c = 0; c < 2; c++)
+    {
+      out.Normal[c] = static_cast<int16_t>(glm::packSnorm1x16(normal[c]));
+      out.Tangent[c] = static_cast<int16_t>(glm::packSnorm1x16(tangent[c]));
+      out.TexCoords[c] = glm::packHalf1x16(vertex.TexCoords[c]);
+    }
+  }
+  return result;
+}
+
+#endif
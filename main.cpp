@@ -11,18 +11,70 @@
 #include "cube.h"
 #include "texture_loader.h"
 #include "model.h"
+#include "gl_extensions.h"
+#include "bindless.h"
+#include "indirect_draw.h"
+#include "headless.h"
+#include "profiler.h"
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 
+// shaders/ and resources/ are found under the repository root, which CMake passes in
+#ifndef LEARNOPENGL_SOURCE_DIR
+#define LEARNOPENGL_SOURCE_DIR "/Users/mashiro_jin/opengl"
+#endif
+
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+// print per-model load time and vertex memory; the first run is cold (Assimp), later runs are warm (*.meshcache)
+const bool MODEL_LOAD_STATS = false;
+// reorder model index/vertex buffers for the post-transform cache and overdraw at import
+const bool OPTIMIZE_MESHES = false;
+// print texture cache hits/misses and memory saved after loading, and the VRAM and load time of compressed textures
+const bool TEXTURE_CACHE_STATS = false;
+// build texture mips on the worker threads (Kaiser filter, diffuse maps in linear light) instead of glGenerateMipmap
+const bool CPU_MIPMAPS = false;
+const MipFilter MIP_FILTER = MipFilter::Kaiser;
+// upload textures block-compressed (BC1/BC3/BC4/BC5) from <image>.dds, transcoded on the first run
+const bool TEXTURE_COMPRESSION = false;
+// decode model textures on worker threads and stream them in over several frames
+const bool ASYNC_TEXTURES = false;
+const size_t TEXTURE_UPLOAD_BUDGET = 8 * 1048576; // bytes per frame
+// load only the mip tail of model textures and stream finer levels in as their meshes get closer, within a VRAM
+// budget; print resident bytes against the budget once per second
+const bool MIP_STREAMING = false;
+const size_t MIP_STREAMING_BUDGET = 64 * 1048576;
+const bool MIP_STREAMING_STATS = false;
+// pack each material slot's model textures into texture arrays so a model's meshes share one set of bindings
+// (and, with INDIRECT_DRAW, one multi-draw); packed textures are fully resident, not mip streamed
+const bool TEXTURE_ARRAYS = false;
+// pass textures to the shaders as resident ARB_bindless_texture handles instead of binding them, where the driver
+// supports it (llvmpipe does not, so it binds as before); takes precedence over MIP_STREAMING, since a texture with a
+// handle can no longer change its mip range. Print binds avoided per frame once per second
+const bool BINDLESS_TEXTURES = false;
+const bool BINDLESS_STATS = false;
+// draw the nanosuits with glMultiDrawElementsIndirect when a GL 4.3 context is available
+const bool INDIRECT_DRAW = false;
+// the nanosuit is drawn NANOSUIT_GRID x NANOSUIT_GRID times
+const unsigned int NANOSUIT_GRID = 1;
+// skip meshes outside the view frustum; print visible/culled mesh counts once per second
+const bool FRUSTUM_CULLING = false;
+const bool CULLING_STATS = false;
+// draw distant meshes with their simplified LODs; print triangles submitted with and without LOD once a second
+const bool LOD_SELECTION = false;
+const bool LOD_STATS = false;
+// with -DLEARNOPENGL_PROFILE, per-pass CPU/GPU times are written here as Chrome trace JSON on exit
+const char *const TRACE_PATH = "learnopengl_trace.json";
+
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f;
@@ -33,61 +85,102 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char **argv)
 {
-  // glfw: initialize and configure
-  // ------------------------------
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // --headless N renders N frames into an offscreen framebuffer and prints frame-time statistics,
+  // see HeadlessOptions; animation then advances a fixed 1/60 s per frame so runs are reproducible
+  HeadlessOptions headless = HeadlessOptions::Parse(argc, argv);
+  unsigned int width = headless.width ? headless.width : SCR_WIDTH;
+  unsigned int height = headless.height ? headless.height : SCR_HEIGHT;
+  HeadlessContext headlessContext;
+  GLFWwindow *window = NULL;
+  if (headless.Enabled())
+  {
+    if (!headlessContext.Create(INDIRECT_DRAW ? 4 : 3, 3))
+      return -1;
+  }
+  else
+  {
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, INDIRECT_DRAW ? 4 : 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-  // glfw window creation
-  // --------------------
-  GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-  {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
+    // glfw window creation
+    // --------------------
+    window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    if (window == NULL && INDIRECT_DRAW)
+    {
+      // no GL 4.3 (e.g. macOS), the indirect path falls back to per-mesh draws
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+      window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    }
+    if (window == NULL)
+    {
+      std::cout << "Failed to create GLFW window" << std::endl;
+      glfwTerminate();
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+
+    // tell GLFW to capture our mouse
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
   }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
-
-  // tell GLFW to capture our mouse
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
   // glad: load all OpenGL function pointers
   // ---------------------------------------
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+  GLADloadproc loadProc = headless.Enabled() ? HeadlessContext::ProcAddressLoader() : (GLADloadproc)glfwGetProcAddress;
+  if (!gladLoadGLLoader(loadProc))
   {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  LoadGLExtensions(loadProc);
+
+  // without a window everything is drawn into this framebuffer
+  std::unique_ptr<OffscreenTarget> offscreen;
+  if (headless.Enabled())
+  {
+    offscreen.reset(new OffscreenTarget(width, height));
+    offscreen->Bind();
+  }
 
   // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
   stbi_set_flip_vertically_on_load(true);
+  TextureCompression::Instance().FlipVertically = true;
 
   // configure global opengl state
   // -----------------------------
   glEnable(GL_DEPTH_TEST);
 
+  MipBuilder::Instance().Enabled = CPU_MIPMAPS;
+  MipBuilder::Instance().Filter = MIP_FILTER;
+  TextureCompression::Instance().Enabled = TEXTURE_COMPRESSION;
+  TextureStreamer::Instance().Enabled = ASYNC_TEXTURES;
+  TextureStreamer::Instance().UploadBudgetBytes = TEXTURE_UPLOAD_BUDGET;
+  BindlessTextures::Instance().Enabled = BINDLESS_TEXTURES;
+  MipStreamer::Instance().Enabled = MIP_STREAMING && !BindlessTextures::Instance().Active();
+  MipStreamer::Instance().BudgetBytes = MIP_STREAMING_BUDGET;
+
   // load skybox
   // -----------
   std::string facePaths[] = 
   {
-    "/Users/mashiro_jin/opengl/resources/skybox/right.jpg",
-    "/Users/mashiro_jin/opengl/resources/skybox/left.jpg",
-    "/Users/mashiro_jin/opengl/resources/skybox/bottom.jpg",
-    "/Users/mashiro_jin/opengl/resources/skybox/top.jpg",
-    "/Users/mashiro_jin/opengl/resources/skybox/front.jpg",
-    "/Users/mashiro_jin/opengl/resources/skybox/back.jpg"
+    LEARNOPENGL_SOURCE_DIR "/resources/skybox/right.jpg",
+    LEARNOPENGL_SOURCE_DIR "/resources/skybox/left.jpg",
+    LEARNOPENGL_SOURCE_DIR "/resources/skybox/bottom.jpg",
+    LEARNOPENGL_SOURCE_DIR "/resources/skybox/top.jpg",
+    LEARNOPENGL_SOURCE_DIR "/resources/skybox/front.jpg",
+    LEARNOPENGL_SOURCE_DIR "/resources/skybox/back.jpg"
   };
   vector<std::string> faces(facePaths, facePaths + 6);
   unsigned int cubeMapTexture = loadCubemap(faces);
@@ -96,18 +189,35 @@ int main()
   // ------------------
   Skybox skybox(cubeMapTexture);
   Cube cube(cubeMapTexture, 0.25);
-  Model nanosuitModel("/Users/mashiro_jin/opengl/resources/objects/nanosuit/nanosuit.obj");
-  Model cyboryModel("/Users/mashiro_jin/opengl/resources/objects/cyborg/cyborg.obj");
+  Model::ReportLoadStats = MODEL_LOAD_STATS;
+  Model::OptimizeMeshes = OPTIMIZE_MESHES;
+  Model::PackTextureArrays = TEXTURE_ARRAYS;
+  Model nanosuitModel(LEARNOPENGL_SOURCE_DIR "/resources/objects/nanosuit/nanosuit.obj");
+  Model cyboryModel(LEARNOPENGL_SOURCE_DIR "/resources/objects/cyborg/cyborg.obj");
+  if (MODEL_LOAD_STATS)
+    std::cout << "MODEL::INDICES " << Model::IndexBytesSaved << " index bytes saved by 16-bit indices" << std::endl;
+  if (TEXTURE_CACHE_STATS)
+  {
+    TextureCache::Instance().PrintStats();
+    if (TEXTURE_COMPRESSION)
+      TextureCompression::Instance().PrintStats();
+    MipBuilder::Instance().PrintStats();
+  }
 
   // draw in wireframe
   // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
   // build and compile shaders
   // -------------------------
-  Shader skyboxShader("/Users/mashiro_jin/opengl/shaders/skybox.vs", "/Users/mashiro_jin/opengl/shaders/skybox.fs");
-  Shader cubemapShader("/Users/mashiro_jin/opengl/shaders/cube.vs", "/Users/mashiro_jin/opengl/shaders/cube_reflect.fs");
-  Shader nanosuitShader("/Users/mashiro_jin/opengl/shaders/nanosuit.vs", "/Users/mashiro_jin/opengl/shaders/nanosuit.fs");
-  Shader cyborgShader("/Users/mashiro_jin/opengl/shaders/cyborg.vs", "/Users/mashiro_jin/opengl/shaders/cyborg.fs");
+  Shader skyboxShader(LEARNOPENGL_SOURCE_DIR "/shaders/skybox.vs", LEARNOPENGL_SOURCE_DIR "/shaders/skybox.fs");
+  Shader cubemapShader(LEARNOPENGL_SOURCE_DIR "/shaders/cube.vs", LEARNOPENGL_SOURCE_DIR "/shaders/cube_reflect.fs");
+  IndirectDrawList nanosuits;
+  nanosuits.Enabled = INDIRECT_DRAW;
+  Shader nanosuitShader(nanosuits.Active() ? LEARNOPENGL_SOURCE_DIR "/shaders/nanosuit_indirect.vs" : LEARNOPENGL_SOURCE_DIR "/shaders/nanosuit.vs",
+                        LEARNOPENGL_SOURCE_DIR "/shaders/nanosuit.fs");
+  for (unsigned int i = 0; i < NANOSUIT_GRID * NANOSUIT_GRID; i++)
+    nanosuits.Add(nanosuitModel, glm::mat4(1.0f));
+  Shader cyborgShader(LEARNOPENGL_SOURCE_DIR "/shaders/cyborg.vs", LEARNOPENGL_SOURCE_DIR "/shaders/cyborg.fs");
 
   // shader configuration
   skyboxShader.use();
@@ -118,77 +228,130 @@ int main()
 
   // render loop
   // -----------
-  while (!glfwWindowShouldClose(window))
+  FrameStats frameStats;
+  for (unsigned int frame = 0; headless.Enabled() ? frame < headless.frames : !glfwWindowShouldClose(window); frame++)
   {
     // per-frame time logic
     // --------------------
-    float currentFrame = static_cast<float>(glfwGetTime());
+    auto frameStart = std::chrono::steady_clock::now();
+    PROFILE_FRAME();
+    PROFILE_SCOPE("frame");
+    float currentFrame = headless.Enabled() ? frame / 60.0f : static_cast<float>(glfwGetTime());
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
     // input
     // -----
-    processInput(window);
+    if (window)
+      processInput(window);
+
+    // stream pending texture uploads within this frame's budget
+    // ---------------------------------------------------------
+    TextureStreamer &streamer = TextureStreamer::Instance();
+    if (streamer.PendingTextures() > 0 && streamer.Update() > 0 && streamer.PendingTextures() == 0)
+      std::cout << "TEXTURE_STREAMER:: all textures resident after " << currentFrame << " s" << std::endl;
+    // and the mip levels last frame's draws asked for
+    if (MipStreamer::Instance().Enabled)
+      MipStreamer::Instance().Update();
 
     // render
     // ------
     glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // per-frame camera data, shared by every shader through the CameraBlock
+    // ---------------------------------------------------------------------
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
+    camera.UpdateUniformBuffer(projection, currentFrame);
+    Frustum frustum = camera.GetFrustum(projection);
+    LodView lodView = camera.GetLodView((float)height);
+    // mip streaming needs the view even without LOD selection; a zero pixel error keeps every mesh at LOD 0
+    if (!LOD_SELECTION)
+      lodView.pixelError = 0.0f;
+    const LodView *drawView = LOD_SELECTION || MipStreamer::Instance().Enabled ? &lodView : nullptr;
+
     // Specular Cube Render
     // -----------
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::rotate(model, glm::radians(30.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-    model = glm::scale(model, glm::vec3(0.5));
-    model = glm::translate(model, glm::vec3(2.0f, -1.0f, 0.0f));
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    cubemapShader.use();
-    cubemapShader.setMat4("model", model);
-    cubemapShader.setMat4("projection", projection);
-    cubemapShader.setMat4("view", view);
-    cubemapShader.setVec3("cameraPos", camera.Position);
-    cube.Draw(cubemapShader);
+    glm::mat4 model;
+    {
+      PROFILE_GPU_SCOPE("cube");
+      model = glm::mat4(1.0f);
+      model = glm::rotate(model, glm::radians(30.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+      model = glm::scale(model, glm::vec3(0.5));
+      model = glm::translate(model, glm::vec3(2.0f, -1.0f, 0.0f));
+      cubemapShader.use();
+      cubemapShader.setMat4("model"_u, model);
+      cube.Draw(cubemapShader);
+    }
 
     // Model nanosuit Render
     // ---------------------
-    nanosuitShader.use();
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(-1.0f, -1.0f, 0.0f)); // translate it down so it's at the center of the scene
-    model = glm::scale(model, glm::vec3(0.1f));     // it's a bit too big for our scene, so scale it down
-    model = glm::rotate(model, currentFrame * glm::radians(5.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    nanosuitShader.setMat4("model", model);
-    nanosuitShader.setMat4("projection", projection);
-    nanosuitShader.setMat4("view", view);
-    // direct light
-    nanosuitShader.setVec3("lightDir", 0.0f, -0.5f, -1.0f);
-    nanosuitShader.setVec3("dirLight.ambient",  glm::vec3(1.0f, 1.0f, 1.0f));
-    nanosuitShader.setVec3("dirLight.diffuse",  glm::vec3(1.0f, 1.0f, 1.0f));
-    nanosuitShader.setVec3("dirLight.specular",  glm::vec3(1.0f, 1.0f, 1.0f));
-    nanosuitModel.Draw(nanosuitShader);
+    {
+      PROFILE_GPU_SCOPE("nanosuit");
+      nanosuitShader.use();
+      for (unsigned int i = 0; i < NANOSUIT_GRID * NANOSUIT_GRID; i++)
+      {
+        glm::vec3 offset(float(i % NANOSUIT_GRID), 0.0f, -float(i / NANOSUIT_GRID));
+        model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(-1.0f, -1.0f, 0.0f) + offset); // translate it down so it's at the center of the scene
+        model = glm::scale(model, glm::vec3(0.1f));     // it's a bit too big for our scene, so scale it down
+        model = glm::rotate(model, currentFrame * glm::radians(5.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        nanosuits.SetTransform(i, model);
+      }
+      // direct light
+      nanosuitShader.setVec3("lightDir"_u, 0.0f, -0.5f, -1.0f);
+      nanosuitShader.setVec3("dirLight.ambient"_u,  glm::vec3(1.0f, 1.0f, 1.0f));
+      nanosuitShader.setVec3("dirLight.diffuse"_u,  glm::vec3(1.0f, 1.0f, 1.0f));
+      nanosuitShader.setVec3("dirLight.specular"_u,  glm::vec3(1.0f, 1.0f, 1.0f));
+      nanosuits.Draw(nanosuitShader, FRUSTUM_CULLING ? &frustum : nullptr, drawView);
+    }
 
     // Model cyborg Render
     // -------------------
-    cyborgShader.use();
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f)); // translate it down so it's at the center of the scene
-    model = glm::scale(model, glm::vec3(0.4f));
-    cyborgShader.setMat4("model", model);
-    cyborgShader.setMat4("projection", projection);
-    cyborgShader.setMat4("view", view);
-    cyborgShader.setVec3("viewPos", camera.Position);
-    cyborgShader.setInt("cubemap", 0);
-    cyboryModel.Draw(cyborgShader);
+    {
+      PROFILE_GPU_SCOPE("cyborg");
+      cyborgShader.use();
+      model = glm::mat4(1.0f);
+      model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f)); // translate it down so it's at the center of the scene
+      model = glm::scale(model, glm::vec3(0.4f));
+      // the cube left the cubemap bound to unit 0, unless it went through the cubemap's handle
+      if (!BindlessTextures::Instance().SetSampler(cyborgShader, "cubemap"_u, cubeMapTexture))
+        cyborgShader.setInt("cubemap"_u, 0);
+      cyboryModel.Draw(cyborgShader, model, FRUSTUM_CULLING ? &frustum : nullptr, drawView);
+    }
+
+    if (FRUSTUM_CULLING && CULLING_STATS && int(currentFrame) != int(currentFrame - deltaTime))
+      std::cout << "CULLING:: visible " << nanosuits.visibleCount + cyboryModel.visibleCount << ", culled "
+                << nanosuits.culledCount + cyboryModel.culledCount << " meshes" << std::endl;
+    if (LOD_STATS && int(currentFrame) != int(currentFrame - deltaTime))
+      std::cout << "LOD:: " << nanosuits.submittedTriangles + cyboryModel.submittedTriangles << " triangles submitted, "
+                << nanosuits.fullTriangles + cyboryModel.fullTriangles << " without LOD" << std::endl;
+    if (MipStreamer::Instance().Enabled && MIP_STREAMING_STATS && int(currentFrame) != int(currentFrame - deltaTime))
+      MipStreamer::Instance().PrintStats();
 
     // Sky box render
-    glDepthFunc(GL_LEQUAL);
-    skyboxShader.use();
-    view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-    skyboxShader.setMat4("projection", projection);
-    skyboxShader.setMat4("view", view);
-    // Draw skybox
-    skybox.Draw(skyboxShader);
-    glDepthFunc(GL_LESS);
+    {
+      PROFILE_GPU_SCOPE("skybox");
+      glDepthFunc(GL_LEQUAL);
+      skyboxShader.use();
+      // Draw skybox
+      skybox.Draw(skyboxShader);
+      glDepthFunc(GL_LESS);
+    }
+
+    BindlessTextures::Instance().EndFrame();
+    if (BINDLESS_STATS && int(currentFrame) != int(currentFrame - deltaTime))
+      BindlessTextures::Instance().PrintStats();
+
+    if (headless.Enabled())
+    {
+      // nothing is presented, so wait for the GPU to make the frame time cover the rendering
+      glFinish();
+      frameStats.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+      if (headless.WritesPNG(frame))
+        offscreen->WritePNG(headless.pngPrefix + std::to_string(frame) + ".png");
+      continue;
+    }
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
     // -------------------------------------------------------------------------------
@@ -196,6 +359,20 @@ int main()
     glfwPollEvents();
   }
 
+  PROFILE_EXPORT(TRACE_PATH);
+  nanosuits.Release(); // while the context is current
+  nanosuitModel.Release();
+  cyboryModel.Release();
+  if (headless.Enabled())
+  {
+    frameStats.Print("HEADLESS");
+    if (!headless.jsonPath.empty())
+      frameStats.WriteJSON(headless.jsonPath, "main");
+    offscreen.reset();
+    headlessContext.Destroy();
+    return 0;
+  }
+
   // glfw: terminate, clearing all previously allocated GLFW resources.
   // ------------------------------------------------------------------
   glfwTerminate();
@@ -0,0 +1,254 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "camera.h"
+#include "texture_loader.h"
+#include "model.h"
+#include "instanced_model.h"
+#include "gl_extensions.h"
+#include "gpu_culling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void processInput(GLFWwindow *window);
+
+// shaders/ and resources/ are found under the repository root, which CMake passes in
+#ifndef LEARNOPENGL_SOURCE_DIR
+#define LEARNOPENGL_SOURCE_DIR "/Users/mashiro_jin/opengl"
+#endif
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+// rocks in the belt; INSTANCED = false draws them with one Model::Draw each for comparison
+const size_t ROCK_COUNT = 100000;
+const bool INSTANCED = true;
+// cull and pick LODs per rock in a compute shader (GL 4.3); otherwise every rock is drawn at LOD 0
+const bool GPU_CULLING = true;
+// read the per-LOD visible rock counts back for the stats line; waits for the GPU every frame
+const bool GPU_CULLING_STATS = false;
+// rocks moved per frame, as one contiguous range so only that range is re-uploaded
+const size_t ROCKS_MOVED_PER_FRAME = 1000;
+const float BELT_RADIUS = 150.0f;
+const float BELT_WIDTH = 25.0f;
+
+// camera
+Camera camera(glm::vec3(0.0f, 40.0f, 220.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, -10.0f);
+
+// timing
+float deltaTime = 0.0f;
+float lastFrame = 0.0f;
+
+// a rock on the belt: offset from the ring, size and tumble are fixed per rock, angleOffset orbits it
+glm::mat4 rockTransform(size_t rock, float angleOffset)
+{
+  std::minstd_rand random(static_cast<unsigned int>(rock) + 1);
+  std::uniform_real_distribution<float> offset(-BELT_WIDTH, BELT_WIDTH);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  float angle = float(rock) / float(ROCK_COUNT) * 360.0f + angleOffset;
+  glm::vec3 position(sin(glm::radians(angle)) * BELT_RADIUS + offset(random), offset(random) * 0.4f,
+                     cos(glm::radians(angle)) * BELT_RADIUS + offset(random));
+  glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+  transform = glm::scale(transform, glm::vec3(0.05f + 0.2f * unit(random)));
+  return glm::rotate(transform, unit(random) * 360.0f, glm::vec3(0.4f, 0.6f, 0.8f));
+}
+
+int main()
+{
+  // glfw: initialize and configure
+  // ------------------------------
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GPU_CULLING ? 4 : 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+  // glfw window creation
+  // --------------------
+  GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+  if (window == NULL && GPU_CULLING)
+  {
+    // no GL 4.3 (e.g. macOS), GpuInstanceCuller falls back to plain instancing
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+  }
+  if (window == NULL)
+  {
+    std::cout << "Failed to create GLFW window" << std::endl;
+    glfwTerminate();
+    return -1;
+  }
+  glfwMakeContextCurrent(window);
+  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  // measure frame time, not the display refresh
+  glfwSwapInterval(0);
+
+  // glad: load all OpenGL function pointers
+  // ---------------------------------------
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+  {
+    std::cout << "Failed to initialize GLAD" << std::endl;
+    return -1;
+  }
+  LoadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+  stbi_set_flip_vertically_on_load(true);
+
+  // configure global opengl state
+  // -----------------------------
+  glEnable(GL_DEPTH_TEST);
+
+  // build and compile shaders
+  // -------------------------
+  Shader rockShader(LEARNOPENGL_SOURCE_DIR "/project/asteroids/rock.vs", LEARNOPENGL_SOURCE_DIR "/project/asteroids/rock.fs");
+
+  // load models and place the rocks
+  // -------------------------------
+  Model rock(LEARNOPENGL_SOURCE_DIR "/resources/objects/rock/rock.obj");
+  std::vector<glm::mat4> transforms(ROCK_COUNT);
+  for (size_t i = 0; i < ROCK_COUNT; i++)
+    transforms[i] = rockTransform(i, 0.0f);
+  InstancedModel rocks(rock, transforms);
+  GpuInstanceCuller culler(LEARNOPENGL_SOURCE_DIR "/shaders/instance_cull.comp");
+  culler.Enabled = GPU_CULLING;
+  culler.ReadBackCounts = GPU_CULLING_STATS;
+
+  size_t triangles = 0;
+  for (const Mesh &mesh : rock.meshes)
+    triangles += mesh.indices.size() / 3;
+  printf("ASTEROIDS:: %zu rocks, %zu triangles each, %s\n", ROCK_COUNT, triangles,
+         !INSTANCED ? "one Model::Draw per rock" : culler.Active() ? "instanced, GPU culled" : "instanced");
+
+  // render loop
+  // -----------
+  std::vector<double> frameMs;
+  size_t movedFirst = 0, uploadedBytes = 0;
+  unsigned int calls = 0;
+  float lastReport = static_cast<float>(glfwGetTime());
+  while (!glfwWindowShouldClose(window))
+  {
+    // per-frame time logic
+    // --------------------
+    auto frameStart = std::chrono::steady_clock::now();
+    float currentFrame = static_cast<float>(glfwGetTime());
+    deltaTime = currentFrame - lastFrame;
+    lastFrame = currentFrame;
+
+    // input
+    // -----
+    processInput(window);
+
+    // move one range of rocks along the belt
+    // --------------------------------------
+    size_t moved = std::min(ROCKS_MOVED_PER_FRAME, ROCK_COUNT - movedFirst);
+    for (size_t i = movedFirst; i < movedFirst + moved; i++)
+      transforms[i] = rockTransform(i, currentFrame);
+    rocks.SetTransforms(movedFirst, &transforms[movedFirst], moved);
+    movedFirst = (movedFirst + moved) % ROCK_COUNT;
+
+    // render
+    // ------
+    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+    camera.UpdateUniformBuffer(projection, currentFrame);
+
+    rockShader.use();
+    rockShader.setVec3("lightDir"_u, glm::normalize(glm::vec3(-0.3f, -1.0f, -0.5f)));
+    if (INSTANCED)
+    {
+      culler.Draw(rocks, rockShader, camera.GetFrustum(projection), camera.GetLodView(SCR_HEIGHT));
+      calls += culler.callCount;
+      uploadedBytes += rocks.uploadedBytes;
+    }
+    else
+    {
+      // the instance attribute is disabled here, so give it an identity current value and
+      // pass each rock's transform through "model" instead
+      for (unsigned int column = 0; column < 4; column++)
+        glVertexAttrib4fv(INSTANCE_MATRIX_ATTRIBUTE + column, &glm::mat4(1.0f)[column][0]);
+      for (const glm::mat4 &transform : transforms)
+      {
+        rock.Draw(rockShader, transform);
+        calls += static_cast<unsigned int>(rock.meshes.size());
+      }
+    }
+
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    // -------------------------------------------------------------------------------
+    glfwSwapBuffers(window);
+    glfwPollEvents();
+
+    // frame time output once a second
+    // -------------------------------
+    frameMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+    if (currentFrame - lastReport >= 1.0f)
+    {
+      std::sort(frameMs.begin(), frameMs.end());
+      double total = 0.0;
+      for (double ms : frameMs)
+        total += ms;
+      size_t frames = frameMs.size();
+      printf("ASTEROIDS:: %zu frames, %.2f ms/frame (%.0f fps), median %.2f ms, max %.2f ms, %u calls/frame, %.1f KB uploaded/frame\n",
+             frames, total / frames, 1000.0 * frames / total, frameMs[frames / 2], frameMs.back(), unsigned(calls / frames),
+             uploadedBytes / 1024.0 / frames);
+      if (culler.Active() && GPU_CULLING_STATS)
+      {
+        printf("ASTEROIDS:: visible rocks per LOD:");
+        for (unsigned int count : culler.lodInstances)
+          printf(" %u", count);
+        printf("\n");
+      }
+      frameMs.clear();
+      calls = 0;
+      uploadedBytes = 0;
+      lastReport = currentFrame;
+    }
+  }
+
+  culler.Release();
+  rocks.Release();
+  rock.Release();
+  // glfw: terminate, clearing all previously allocated GLFW resources.
+  // ------------------------------------------------------------------
+  glfwTerminate();
+  return 0;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow *window)
+{
+  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    glfwSetWindowShouldClose(window, true);
+
+  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    camera.ProcessKeyboard(FORWARD, deltaTime);
+  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    camera.ProcessKeyboard(BACKWARD, deltaTime);
+  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    camera.ProcessKeyboard(LEFT, deltaTime);
+  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    camera.ProcessKeyboard(RIGHT, deltaTime);
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow *window, int width, int height)
+{
+  glViewport(0, 0, width, height);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 Normal;
+
+uniform sampler2D texture_diffuse1;
+uniform vec3 lightDir;
+
+void main()
+{
+  float diffuse = max(dot(normalize(Normal), -lightDir), 0.0);
+  FragColor = vec4(texture(texture_diffuse1, TexCoords).rgb * (0.2 + 0.8 * diffuse), 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 8) in mat4 aInstanceMatrix; // see INSTANCE_MATRIX_ATTRIBUTE
+
+out vec2 TexCoords;
+out vec3 Normal;
+
+// node transform of the mesh; the per-rock transform comes from aInstanceMatrix
+uniform mat4 model;
+
+#include "../../shaders/camera.glsl"
+#include "../../shaders/material.glsl"
+#include "../../shaders/packed_vertex.glsl"
+
+void main()
+{
+  vec3 position = aPos.xyz * material.positionScale.xyz + material.positionOffset.xyz;
+  vec3 normal = material.positionScale.w != 0.0 ? octDecode(aNormal.xy) : aNormal;
+  mat4 world = aInstanceMatrix * model;
+  TexCoords = aTexCoords;
+  Normal = mat3(world) * normal;
+  gl_Position = camera.viewProjection * world * vec4(position, 1.0);
+}
@@ -0,0 +1,473 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "camera.h"
+#include "texture_loader.h"
+#include "gl_extensions.h"
+#include "headless.h"
+#include "frame_stats.h"
+#include "mip_streamer.h"
+#include "texture_array.h"
+#include "profiler.h"
+#ifdef LEARNOPENGL_ASSIMP
+#include "model.h"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the learnopengl headers on a headless EGL context (Mesa llvmpipe works).
+//   benchmark [--json PATH] [--filter TEXT] [--iterations N]
+// Prints one BENCHMARK:: line per benchmark; --json writes the same results for scripts.
+// The Model benchmarks need Assimp (LEARNOPENGL_ASSIMP, set by CMake when it is found); the processMesh
+// times need the profiler scopes (LEARNOPENGL_PROFILE, which CMake sets for this target only).
+
+#ifndef LEARNOPENGL_SOURCE_DIR
+#define LEARNOPENGL_SOURCE_DIR "/Users/mashiro_jin/opengl"
+#endif
+
+// settings
+const unsigned int DEFAULT_ITERATIONS = 20;
+const unsigned int CAMERA_CALLS_PER_ITERATION = 10000;
+
+struct BenchmarkResult
+{
+  std::string name;
+  FrameStats stats;      // ms per iteration
+  double bytes = 0.0;    // processed per iteration, for MB/s
+  double items = 0.0;    // processed per iteration, for the per-item time
+};
+
+std::vector<BenchmarkResult> results;
+std::string filter;
+unsigned int iterations = DEFAULT_ITERATIONS;
+
+std::string sourcePath(const std::string &relative)
+{
+  return std::string(LEARNOPENGL_SOURCE_DIR) + "/" + relative;
+}
+
+void report(const BenchmarkResult &result);
+
+// one untimed warm-up call, then iterations timed calls; GL work is finished inside the timing
+void run(const std::string &name, double bytes, double items, const std::function<void()> &body)
+{
+  if (!filter.empty() && name.find(filter) == std::string::npos)
+    return;
+  BenchmarkResult result;
+  result.name = name;
+  result.bytes = bytes;
+  result.items = items;
+  body();
+  glFinish();
+  for (unsigned int i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    glFinish();
+    result.stats.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+
+  report(result);
+}
+
+void report(const BenchmarkResult &result)
+{
+  double mean = result.stats.Mean();
+  printf("BENCHMARK:: %-32s mean %9.3f ms, p50 %9.3f ms, p95 %9.3f ms", result.name.c_str(), mean, result.stats.Percentile(50.0),
+         result.stats.Percentile(95.0));
+  if (result.bytes > 0.0 && mean > 0.0)
+    printf(", %8.1f MB/s", result.bytes / 1048576.0 / (mean / 1000.0));
+  if (result.items > 0.0)
+    printf(", %9.3f us/item", mean * 1000.0 / result.items);
+  printf("\n");
+  results.push_back(result);
+}
+
+bool writeJSON(const std::string &path)
+{
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file)
+  {
+    std::cout << "ERROR::BENCHMARK::WRITE_FAILED " << path << std::endl;
+    return false;
+  }
+  fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"benchmarks\": [", (const char *)glGetString(GL_RENDERER));
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchmarkResult &result = results[i];
+    double mean = result.stats.Mean();
+    fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %zu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, "
+                  "\"max_ms\": %.4f, \"mb_per_s\": %.2f, \"us_per_item\": %.4f}",
+            i == 0 ? "" : ",", result.name.c_str(), result.stats.Count(), mean, result.stats.Percentile(50.0), result.stats.Percentile(95.0),
+            result.stats.Percentile(99.0), result.stats.Max(), result.bytes > 0.0 && mean > 0.0 ? result.bytes / 1048576.0 / (mean / 1000.0) : 0.0,
+            result.items > 0.0 ? mean * 1000.0 / result.items : 0.0);
+  }
+  fprintf(file, "\n  ]\n}\n");
+  fclose(file);
+  return true;
+}
+
+std::vector<unsigned char> readFile(const std::string &path)
+{
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void printUsage(const char *program)
+{
+  std::cout << "usage: " << program << " [--json PATH] [--filter TEXT] [--iterations N]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  std::string jsonPath;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+    {
+      printUsage(argv[0]);
+      return 0;
+    }
+    bool known = strcmp(arg, "--json") == 0 || strcmp(arg, "--filter") == 0 || strcmp(arg, "--iterations") == 0;
+    if (!known || i + 1 == argc)
+    {
+      std::cout << (known ? "ERROR::BENCHMARK::MISSING_VALUE " : "ERROR::BENCHMARK::UNKNOWN_OPTION ") << arg << std::endl;
+      printUsage(argv[0]);
+      return 1;
+    }
+    const char *value = argv[++i];
+    if (strcmp(arg, "--json") == 0)
+      jsonPath = value;
+    else if (strcmp(arg, "--filter") == 0)
+      filter = value;
+    else
+      iterations = std::max(1u, unsigned(strtoul(value, nullptr, 10)));
+  }
+
+  // measure real compiles, not Mesa's on-disk shader cache
+  setenv("MESA_SHADER_CACHE_DISABLE", "true", 0);
+  HeadlessContext context;
+  if (!context.Create(4, 3) || !gladLoadGLLoader(HeadlessContext::ProcAddressLoader()))
+    return -1;
+  LoadGLExtensions(HeadlessContext::ProcAddressLoader());
+  printf("BENCHMARK:: renderer %s, GL %d.%d, %u iterations\n", (const char *)glGetString(GL_RENDERER), GLContextMajor, GLContextMinor,
+         iterations);
+  stbi_set_flip_vertically_on_load(true);
+  TextureCompression::Instance().FlipVertically = true;
+
+  // image decode: stbi_load_from_memory on every bundled PNG/JPG, so file IO is not measured
+  // -----------------------------------------------------------------------------------------
+  std::vector<std::string> pngs, jpgs;
+  for (const auto &entry : std::filesystem::recursive_directory_iterator(sourcePath("resources")))
+  {
+    std::string extension = entry.path().extension().string();
+    if (extension == ".png")
+      pngs.push_back(entry.path().string());
+    else if (extension == ".jpg")
+      jpgs.push_back(entry.path().string());
+  }
+  for (const std::vector<std::string> *images : {&pngs, &jpgs})
+  {
+    std::vector<std::vector<unsigned char>> files;
+    double decodedBytes = 0.0;
+    for (const std::string &path : *images)
+    {
+      files.push_back(readFile(path));
+      int width = 0, height = 0, components = 0;
+      if (stbi_info_from_memory(files.back().data(), int(files.back().size()), &width, &height, &components))
+        decodedBytes += double(width) * height * components;
+    }
+    run(images == &pngs ? "stbi_load png" : "stbi_load jpg", decodedBytes, double(files.size()), [&]() {
+      for (const std::vector<unsigned char> &file : files)
+      {
+        int width, height, components;
+        stbi_image_free(stbi_load_from_memory(file.data(), int(file.size()), &width, &height, &components, 0));
+      }
+    });
+  }
+
+  // CPU mip chains of decoded textures, per filter: the 1-thread run is the per-core throughput
+  // -------------------------------------------------------------------------------------------
+  struct MipSource
+  {
+    const char *path = nullptr;
+    MipOptions options = {};
+    int width = 0, height = 0, components = 0;
+    unsigned char *pixels = nullptr;
+  };
+  MipSource mipSources[] = {{"resources/objects/nanosuit/body_dif.png"}, {"resources/objects/nanosuit/body_showroom_ddn.png"},
+                            {"resources/textures/container.png"}, {"resources/skybox/right.jpg"}};
+  mipSources[0].options.srgb = mipSources[2].options.srgb = mipSources[3].options.srgb = true;
+  mipSources[1].options.normalMap = true;
+  mipSources[3].options.wrap = false;
+  double mipBytes = 0.0;
+  for (MipSource &source : mipSources)
+  {
+    source.pixels = stbi_load(sourcePath(source.path).c_str(), &source.width, &source.height, &source.components, 0);
+    if (source.pixels)
+      mipBytes += double(source.width) * source.height * source.components;
+  }
+  const char *filterNames[] = {"box", "kaiser", "lanczos"};
+  for (MipFilter mipFilter : {MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos})
+  {
+    MipBuilder::Instance().Filter = mipFilter;
+    for (bool parallel : {false, true})
+    {
+      unsigned int threads = parallel ? WorkerPool().Size() + 1 : 1;
+      run(std::string("mips ") + filterNames[int(mipFilter)] + " " + std::to_string(threads) + (threads == 1 ? " thread" : " threads"), mipBytes,
+          double(std::size(mipSources)), [&]() {
+            for (MipSource &source : mipSources)
+            {
+              if (!source.pixels)
+                continue;
+              MipOptions options = source.options;
+              options.parallel = parallel;
+              MipBuilder::Instance().Build(source.pixels, source.width, source.height, source.components, options);
+            }
+          });
+    }
+  }
+  for (MipSource &source : mipSources)
+    stbi_image_free(source.pixels);
+  MipBuilder::Instance().Filter = MipFilter::Kaiser;
+
+  // texture loads: file read, decode, upload and mipmaps, bypassing the TextureCache
+  // ---------------------------------------------------------------------------------
+  std::string texturePath = sourcePath("resources/textures/container.png");
+  size_t textureBytes = 0;
+  unsigned int probe = loadTextureUncached(texturePath.c_str(), textureBytes);
+  glDeleteTextures(1, &probe);
+  run("loadTexture container.png", double(textureBytes), 1.0, [&]() {
+    size_t bytes = 0;
+    unsigned int texture = loadTextureUncached(texturePath.c_str(), bytes);
+    glDeleteTextures(1, &texture);
+  });
+#ifdef LEARNOPENGL_ASSIMP
+  std::string modelTexturePath = sourcePath("resources/objects/nanosuit/body_dif.png");
+  probe = TextureFromFileUncached(modelTexturePath, textureBytes);
+  glDeleteTextures(1, &probe);
+  run("TextureFromFile body_dif.png", double(textureBytes), 1.0, [&]() {
+    size_t bytes = 0;
+    unsigned int texture = TextureFromFileUncached(modelTexturePath, bytes);
+    glDeleteTextures(1, &texture);
+  });
+#endif
+
+  std::vector<std::string> faces;
+  for (const char *face : {"right", "left", "bottom", "top", "front", "back"})
+    faces.push_back(sourcePath("resources/skybox/") + face + ".jpg");
+  size_t cubemapBytes = 0;
+  probe = loadCubemapUncached(faces, cubemapBytes);
+  glDeleteTextures(1, &probe);
+  run("loadCubemap skybox", double(cubemapBytes), 6.0, [&]() {
+    size_t bytes = 0;
+    unsigned int texture = loadCubemapUncached(faces, bytes);
+    glDeleteTextures(1, &texture);
+  });
+
+  // block compression: transcode speed, VRAM of every model texture, and warm .dds loads
+  // compared with the uncompressed loads above
+  // -------------------------------------------------------------------------------------
+  TextureCompression &compression = TextureCompression::Instance();
+  for (const char *name : {"nanosuit/body_dif.png", "nanosuit/body_showroom_ddn.png"})
+  {
+    std::string path = sourcePath("resources/objects/") + name;
+    int width, height, components;
+    unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &components, 4);
+    if (!pixels)
+      continue;
+    BlockFormat format = ChooseBlockFormat(path, pixels, width, height, components);
+    run(std::string(BlockFormatName(format)) + " encode+mips " + name, double(width) * height * 4, 1.0,
+        [&]() { CompressImage(pixels, width, height, format, true); });
+    stbi_image_free(pixels);
+  }
+
+  compression.Enabled = true;
+  std::vector<std::string> modelTextures;
+  for (const auto &entry : std::filesystem::recursive_directory_iterator(sourcePath("resources/objects")))
+  {
+    std::string extension = entry.path().extension().string();
+    if (extension == ".png" || extension == ".jpg")
+      modelTextures.push_back(entry.path().string());
+  }
+  for (int pass = 0; pass < 2; pass++)
+  {
+    // the first pass transcodes whatever has no .dds yet, the second reports warm loads
+    compression.ResetStats();
+    for (const std::string &path : modelTextures)
+    {
+      size_t bytes = 0;
+      unsigned int texture = compression.LoadTexture2D(path, bytes);
+      glDeleteTextures(1, &texture);
+    }
+  }
+  compression.PrintStats();
+
+  std::string bodyPath = sourcePath("resources/objects/nanosuit/body_dif.png");
+  const char *variants[] = {"", " (CPU mips)", " (BC .dds)"};
+  for (int variant = 0; variant < 3; variant++)
+  {
+    MipBuilder::Instance().Enabled = variant == 1;
+    compression.Enabled = variant == 2;
+    probe = loadTextureUncached(bodyPath.c_str(), textureBytes, true);
+    glDeleteTextures(1, &probe);
+    run(std::string("loadTexture body_dif.png") + variants[variant], double(textureBytes), 1.0, [&]() {
+      size_t bytes = 0;
+      unsigned int texture = loadTextureUncached(bodyPath.c_str(), bytes, true);
+      glDeleteTextures(1, &texture);
+    });
+  }
+  MipBuilder::Instance().Enabled = false;
+  cubemapBytes = 0;
+  probe = loadCubemapUncached(faces, cubemapBytes);
+  glDeleteTextures(1, &probe);
+  run("loadCubemap skybox (BC .dds)", double(cubemapBytes), 6.0, [&]() {
+    size_t bytes = 0;
+    unsigned int texture = loadCubemapUncached(faces, bytes);
+    glDeleteTextures(1, &texture);
+  });
+  compression.Enabled = false;
+
+  // mip streaming: the tail-only load a streamed texture starts with, and that load followed by
+  // streaming every finer level back in on the WorkerPool
+  // ------------------------------------------------------------------------------------------
+  MipStreamer &mipStreamer = MipStreamer::Instance();
+  for (int compressed = 0; compressed < 2; compressed++)
+  {
+    compression.Enabled = compressed == 1;
+    const char *suffix = compressed ? " (BC .dds)" : "";
+    size_t chainBytes = 0;
+    probe = mipStreamer.Load(bodyPath, true, chainBytes);
+    mipStreamer.Forget(probe);
+    glDeleteTextures(1, &probe);
+    run(std::string("MipStreamer load tail body_dif.png") + suffix, double(chainBytes), 1.0, [&]() {
+      size_t bytes = 0;
+      unsigned int texture = mipStreamer.Load(bodyPath, true, bytes);
+      mipStreamer.Forget(texture);
+      glDeleteTextures(1, &texture);
+    });
+    run(std::string("MipStreamer load+stream level 0 body_dif.png") + suffix, double(chainBytes), 1.0, [&]() {
+      size_t bytes = 0;
+      unsigned int texture = mipStreamer.Load(bodyPath, true, bytes);
+      mipStreamer.Request(texture, 1e-6f);
+      mipStreamer.Update();
+      mipStreamer.Flush();
+      mipStreamer.Forget(texture);
+      glDeleteTextures(1, &texture);
+    });
+  }
+  compression.Enabled = false;
+
+  // packing the nanosuit's diffuse maps into texture arrays, as Model::PackTextureArrays does per
+  // slot: uncompressed (glass_dif.png is resampled to 1024x1024) and from the BC .dds files
+  // ----------------------------------------------------------------------------------------
+  for (int compressed = 0; compressed < 2; compressed++)
+  {
+    compression.Enabled = compressed == 1;
+    MipBuilder::Instance().Enabled = true;
+    std::vector<unsigned int> diffuseMaps;
+    for (const char *name : {"arm_dif.png", "body_dif.png", "glass_dif.png", "hand_dif.png", "helmet_diff.png", "leg_dif.png"})
+    {
+      size_t bytes = 0;
+      diffuseMaps.push_back(loadTextureUncached((sourcePath("resources/objects/nanosuit/") + name).c_str(), bytes, true));
+    }
+    MipOptions options;
+    options.srgb = true;
+    size_t arrayBytes = 0;
+    run(std::string("TextureArrays pack nanosuit diffuse") + (compressed ? " (BC .dds)" : ""), 0.0, double(diffuseMaps.size()), [&]() {
+      TextureArrays arrays;
+      arrays.Pack(diffuseMaps, options);
+      arrayBytes = arrays.bytes;
+    });
+    if (arrayBytes > 0)
+      printf("TEXTURE_ARRAYS:: %zu diffuse maps -> %.1f MB of arrays\n", diffuseMaps.size(), arrayBytes / 1048576.0);
+    glDeleteTextures(GLsizei(diffuseMaps.size()), diffuseMaps.data());
+  }
+  MipBuilder::Instance().Enabled = false;
+  compression.Enabled = false;
+
+  // shader compile and link of every program main.cpp uses
+  // ------------------------------------------------------
+  const char *programs[][2] = {{"shaders/skybox.vs", "shaders/skybox.fs"},
+                               {"shaders/cube.vs", "shaders/cube_reflect.fs"},
+                               {"shaders/nanosuit.vs", "shaders/nanosuit.fs"},
+                               {"shaders/cyborg.vs", "shaders/cyborg.fs"}};
+  run("Shader compile+link", 0.0, double(std::size(programs)), [&]() {
+    for (const auto &program : programs)
+    {
+      Shader shader(sourcePath(program[0]).c_str(), sourcePath(program[1]).c_str());
+      glDeleteProgram(shader.ID);
+    }
+  });
+
+  // camera matrices
+  // ---------------
+  Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+  volatile float sink = 0.0f;
+  run("Camera view+frustum+lod", 0.0, CAMERA_CALLS_PER_ITERATION, [&]() {
+    for (unsigned int i = 0; i < CAMERA_CALLS_PER_ITERATION; i++)
+    {
+      camera.ProcessMouseMovement(0.01f, 0.0f);
+      glm::mat4 view = camera.GetViewMatrix();
+      Frustum frustum = camera.GetFrustum(projection);
+      LodView lodView = camera.GetLodView(600.0f);
+      sink = sink + view[3][0] + frustum.planes[0].w + lodView.pixelsPerUnit;
+    }
+  });
+  run("Camera UpdateUniformBuffer", 0.0, CAMERA_CALLS_PER_ITERATION, [&]() {
+    for (unsigned int i = 0; i < CAMERA_CALLS_PER_ITERATION; i++)
+      camera.UpdateUniformBuffer(projection, float(i));
+  });
+
+#ifdef LEARNOPENGL_ASSIMP
+  // model loads: Assimp import and conversion vs the binary mesh cache. A resident copy keeps the
+  // textures in the TextureCache, so the loads below measure geometry only
+  // ---------------------------------------------------------------------------------------------
+  for (const char *name : {"nanosuit/nanosuit.obj", "cyborg/cyborg.obj", "rock/rock.obj"})
+  {
+    std::string path = sourcePath("resources/objects/") + name;
+    Model::UseMeshCache = false;
+    Model resident(path);
+    run(std::string("Model cold (assimp) ") + name, 0.0, 0.0, [&]() { Model model(path); });
+
+    // processMesh alone: every call of a serial import is one sample
+    Model::ParallelImport = false;
+    uint64_t since = Profiler::Instance().Now();
+    run(std::string("Model cold serial ") + name, 0.0, double(resident.meshes.size()), [&]() { Model model(path); });
+    Model::ParallelImport = true;
+    BenchmarkResult conversion;
+    conversion.name = std::string("processMesh ") + name;
+    for (const TraceEvent &event : Profiler::Instance().Events())
+      if (event.start >= since && strcmp(event.name, "processMesh") == 0)
+        conversion.stats.Add(event.duration / 1e6);
+    if (conversion.stats.Count() > 0 && (filter.empty() || conversion.name.find(filter) != std::string::npos))
+      report(conversion);
+
+    Model::UseMeshCache = true;
+    {
+      Model model(path); // writes the cache
+    }
+    run(std::string("Model warm (mesh cache) ") + name, 0.0, 0.0, [&]() { Model model(path); });
+  }
+#endif
+
+  if (!jsonPath.empty())
+    writeJSON(jsonPath);
+  context.Destroy();
+  return 0;
+}
@@ -17,6 +17,11 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char *path);
 
+// shaders/ and resources/ are found under the repository root, which CMake passes in
+#ifndef LEARNOPENGL_SOURCE_DIR
+#define LEARNOPENGL_SOURCE_DIR "/Users/mashiro_jin/opengl"
+#endif
+
 // settings
 const unsigned int SCR_WIDTH = 600;
 const unsigned int SCR_HEIGHT = 600;
@@ -70,7 +75,7 @@ int main()
 
     // build and compile our shader program
     // ------------------------------------
-    Shader ourShader("/Users/mashiro_jin/opengl/shader.vs", "/Users/mashiro_jin/opengl/shader.fs");
+    Shader ourShader(LEARNOPENGL_SOURCE_DIR "/project/cube/shader.vs", LEARNOPENGL_SOURCE_DIR "/project/cube/shader.fs");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -127,8 +132,8 @@ int main()
     glEnableVertexAttribArray(2);
 
     // Texture
-    unsigned int texture = loadTexture("/Users/mashiro_jin/opengl/resources/textures/container.png");
-    unsigned int specularTexture = loadTexture("/Users/mashiro_jin/opengl/resources/textures/container_specular.png");
+    unsigned int texture = loadTexture(LEARNOPENGL_SOURCE_DIR "/resources/textures/container.png");
+    unsigned int specularTexture = loadTexture(LEARNOPENGL_SOURCE_DIR "/resources/textures/container_specular.png");
 
     // uncomment this call to draw in wireframe polygons.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
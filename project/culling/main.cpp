@@ -0,0 +1,77 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// CPU-only frustum culling benchmark: no window or GL context needed.
+// build e.g. g++ -std=c++17 -O2 -I ../../glfw/include -I ../../learnopengl main.cpp
+
+// settings
+const size_t BOX_COUNT = 1000000;
+const int ITERATIONS = 50;
+
+int main()
+{
+  // boxes scattered around the camera; only a few percent fall inside the 45 degree frustum
+  std::mt19937 random(1234);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> size(0.1f, 2.0f);
+  std::vector<AABB> boxes(BOX_COUNT);
+  for (AABB &box : boxes)
+  {
+    glm::vec3 center(position(random), position(random), position(random));
+    glm::vec3 extent(size(random), size(random), size(random));
+    box.min = center - extent;
+    box.max = center + extent;
+  }
+
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = Frustum::FromMatrix(projection * view);
+
+  FrustumCuller culler;
+  culler.Resize(BOX_COUNT);
+  for (size_t i = 0; i < BOX_COUNT; i++)
+    culler.Set(i, boxes[i]);
+
+  // reference: one Frustum::Intersects per box on the array-of-structures data
+  std::vector<uint8_t> reference(BOX_COUNT);
+  auto start = std::chrono::steady_clock::now();
+  unsigned int referenceVisible = 0;
+  for (int iteration = 0; iteration < ITERATIONS; iteration++)
+  {
+    referenceVisible = 0;
+    for (size_t i = 0; i < BOX_COUNT; i++)
+      referenceVisible += reference[i] = frustum.Intersects(boxes[i]);
+  }
+  double referenceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+  printf("CULLING:: %zu boxes, %u visible\n", BOX_COUNT, referenceVisible);
+  printf("CULLING:: %-8s %8.3f ms  %8.1f Mboxes/s\n", "aos", referenceMs, BOX_COUNT / referenceMs / 1000.0);
+
+  const char *names[] = {"scalar", "sse", "avx"};
+  for (int path = CULL_SCALAR; path <= CULL_AVX; path++)
+  {
+    if (!FrustumCuller::PathAvailable(CullPath(path)))
+    {
+      printf("CULLING:: %-8s unavailable on this CPU\n", names[path]);
+      continue;
+    }
+    start = std::chrono::steady_clock::now();
+    for (int iteration = 0; iteration < ITERATIONS; iteration++)
+      culler.Cull(frustum, CullPath(path));
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < BOX_COUNT; i++)
+      mismatches += culler.visible[i] != reference[i];
+    printf("CULLING:: %-8s %8.3f ms  %8.1f Mboxes/s  %.2fx  (%u visible, %zu mismatches)\n", names[path], ms,
+           BOX_COUNT / ms / 1000.0, referenceMs / ms, culler.visibleCount, mismatches);
+  }
+  return 0;
+}
@@ -1,5 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
@@ -9,8 +9,11 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#include "../../shaders/material.glsl"
+
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 position = aPos.xyz * material.positionScale.xyz + material.positionOffset.xyz;
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include "shader.h"
 #include "camera.h"
+#include "texture_loader.h"
 #include "model.h"
 
 #include <iostream>
@@ -17,6 +18,11 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 
+// shaders/ and resources/ are found under the repository root, which CMake passes in
+#ifndef LEARNOPENGL_SOURCE_DIR
+#define LEARNOPENGL_SOURCE_DIR "/Users/mashiro_jin/opengl"
+#endif
+
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -78,11 +84,11 @@ int main()
 
   // build and compile shaders
   // -------------------------
-  Shader ourShader("/Users/mashiro_jin/opengl/model_light.vs", "/Users/mashiro_jin/opengl/model_light.fs");
+  Shader ourShader(LEARNOPENGL_SOURCE_DIR "/project/model/1.model_loading.vs", LEARNOPENGL_SOURCE_DIR "/project/model/1.model_loading.fs");
 
   // load models
   // -----------
-  Model ourModel("/Users/mashiro_jin/opengl/resources/objects/nanosuit/nanosuit.obj");
+  Model ourModel(LEARNOPENGL_SOURCE_DIR "/resources/objects/nanosuit/nanosuit.obj");
 
   // draw in wireframe
   // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -120,8 +126,7 @@ int main()
     model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f)); // translate it down so it's at the center of the scene
     model = glm::scale(model, glm::vec3(0.14f, 0.14f, 0.14f));     // it's a bit too big for our scene, so scale it down
     model = glm::rotate(model, currentFrame * glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    ourShader.setMat4("model", model);
-    ourModel.Draw(ourShader);
+    ourModel.Draw(ourShader, model);
 
     // direct light
     ourShader.setVec3("lightDir", 0.0f, 0.0f, -1.0f);
@@ -138,6 +143,7 @@ int main()
     glfwPollEvents();
   }
 
+  ourModel.Release(); // while the context is current
   // glfw: terminate, clearing all previously allocated GLFW resources.
   // ------------------------------------------------------------------
   glfwTerminate();
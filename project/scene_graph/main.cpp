@@ -0,0 +1,84 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scene_graph.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// CPU-only benchmark of SceneGraph world-matrix updates: no window or GL context needed.
+// build e.g. g++ -std=c++17 -O2 -I ../../glfw/include -I ../../learnopengl main.cpp
+
+// settings
+const size_t NODE_COUNT = 100000;
+const float CHANGED_PER_FRAME = 0.01f;
+const int FRAMES = 200;
+
+int main()
+{
+  std::mt19937 random(1234);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  auto randomTransform = [&]()
+  {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(unit(random), unit(random), unit(random)));
+    return glm::rotate(transform, unit(random), glm::normalize(glm::vec3(unit(random), unit(random), 1.0f)));
+  };
+
+  // random tree built depth-first: each node hangs off some node on the current root path
+  SceneGraph graph;
+  std::vector<int> path;
+  std::geometric_distribution<int> climb(0.5);
+  while (graph.Size() < NODE_COUNT)
+  {
+    int up = std::min<int>(climb(random), int(path.size()));
+    path.resize(path.size() - up);
+    if (path.size() > 12)
+      path.resize(12);
+    int node = graph.AddNode(path.empty() ? -1 : path.back(), randomTransform());
+    path.push_back(node);
+  }
+
+  size_t changed = size_t(NODE_COUNT * CHANGED_PER_FRAME);
+
+  // rotates `changed` random nodes per frame and times only the world-matrix update
+  auto run = [&](bool incremental, double &milliseconds, size_t &recomputed)
+  {
+    std::uniform_int_distribution<int> pick(0, int(NODE_COUNT) - 1);
+    milliseconds = 0.0;
+    recomputed = 0;
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+      for (size_t i = 0; i < changed; i++)
+      {
+        int node = pick(random);
+        graph.SetLocal(node, glm::rotate(graph.local[node], 0.01f, glm::vec3(0.0f, 1.0f, 0.0f)));
+      }
+      auto start = std::chrono::steady_clock::now();
+      recomputed += incremental ? graph.Update() : graph.UpdateAll();
+      milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    milliseconds /= FRAMES;
+    recomputed /= FRAMES;
+  };
+
+  double fullMs, incrementalMs;
+  size_t fullNodes, incrementalNodes;
+  run(false, fullMs, fullNodes);
+  run(true, incrementalMs, incrementalNodes);
+
+  // the incremental result must match a full recompute of the same local matrices
+  std::vector<glm::mat4> incremental = graph.world;
+  graph.UpdateAll();
+  float maxError = 0.0f;
+  for (size_t i = 0; i < NODE_COUNT; i++)
+    for (int c = 0; c < 4; c++)
+      maxError = std::max(maxError, glm::length(incremental[i][c] - graph.world[i][c]));
+
+  printf("SCENE_GRAPH:: %zu nodes, %zu changed per frame\n", NODE_COUNT, changed);
+  printf("SCENE_GRAPH:: full        %8.3f ms/frame  %7zu matrices\n", fullMs, fullNodes);
+  printf("SCENE_GRAPH:: incremental %8.3f ms/frame  %7zu matrices  %.1fx  (max error %g)\n", incrementalMs, incrementalNodes,
+         fullMs / incrementalMs, maxError);
+  return 0;
+}
@@ -0,0 +1,8 @@
+// per-frame camera data shared by every program, see CameraUniforms
+layout (std140) uniform CameraBlock {
+  mat4 view;
+  mat4 projection;
+  mat4 viewProjection;
+  vec4 position;
+  vec4 time;
+} camera;
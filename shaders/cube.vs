@@ -6,12 +6,12 @@ out vec3 Normal;
 out vec3 Position;
 
 uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
+
+#include "camera.glsl"
 
 void main()
 { 
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
+  gl_Position = camera.viewProjection * model * vec4(aPos, 1.0);
   Position = vec3(model * vec4(aPos, 1.0));
   Normal = mat3(transpose(inverse(model))) * aNormal;
 }
\ No newline at end of file
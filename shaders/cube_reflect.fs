@@ -1,16 +1,23 @@
 #version 330 core
+#extension GL_ARB_bindless_texture : enable
 out vec4 FragColor;
 
 in vec3 Normal;
 in vec3 Position;
 
-uniform vec3 cameraPos;
+// set to the cubemap's handle when bindless textures are available, see BindlessTextures
+#ifdef GL_ARB_bindless_texture
+layout (bindless_sampler) uniform samplerCube skybox;
+#else
 uniform samplerCube skybox;
+#endif
+
+#include "camera.glsl"
 
 void main()
 {
   float ratio = 1.00 / 1.33;
-  vec3 I = normalize(Position - cameraPos);
+  vec3 I = normalize(Position - camera.position.xyz);
   vec3 R = reflect(I, normalize(Normal));
   FragColor = vec4(texture(skybox, vec3(R.x, -R.y, R.z)).rgb, 1.0);
 }
\ No newline at end of file
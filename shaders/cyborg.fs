@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_ARB_bindless_texture : enable
 out vec4 FragColor;
 
 in VS_OUT {
@@ -6,18 +7,23 @@ in VS_OUT {
   vec3 Position;
 } fs_in;
 
-uniform vec3 viewPos;
+#include "camera.glsl"
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
 uniform sampler2D texture_normal1;
 uniform sampler2D texture_height1;
+// set to the cubemap's handle when bindless textures are available, see BindlessTextures
+#ifdef GL_ARB_bindless_texture
+layout (bindless_sampler) uniform samplerCube cubemap;
+#else
 uniform samplerCube cubemap;
+#endif
 
 void main()
 {
   float ratio = 1.00 / 1.52;
-  vec3 I = normalize(fs_in.Position - viewPos);
+  vec3 I = normalize(fs_in.Position - camera.position.xyz);
   vec3 R = refract(I, normalize(fs_in.Normal), ratio);
   FragColor = vec4(texture(cubemap, vec3(R.x, -R.y, R.z)).rgb, 1.0);
 }
\ No newline at end of file
@@ -1,5 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
@@ -11,12 +11,18 @@ out VS_OUT {
 } vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "camera.glsl"
+#include "material.glsl"
+#include "packed_vertex.glsl"
 
 void main()
 {
-  vs_out.Normal = mat3(transpose(inverse(model))) * aNormal;
-  vs_out.Position = vec3(model * vec4(aPos, 1.0));
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
+  vec3 position = aPos.xyz * material.positionScale.xyz + material.positionOffset.xyz;
+  bool packedVertex = material.positionScale.w != 0.0;
+  vec3 normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
+
+  vs_out.Normal = mat3(transpose(inverse(model))) * normal;
+  vs_out.Position = vec3(model * vec4(position, 1.0));
+  gl_Position = camera.viewProjection * model * vec4(position, 1.0);
 }
\ No newline at end of file
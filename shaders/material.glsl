@@ -0,0 +1,9 @@
+// per-mesh constants, see MaterialConstants; positionScale.w is 1 for the packed vertex layout,
+// layers selects the texture array layer per slot (-1 for the 2D texture)
+layout (std140) uniform MaterialBlock {
+  vec4 diffuseColor;
+  vec4 specularColor;
+  vec4 positionScale;
+  vec4 positionOffset;
+  ivec4 layers;
+} material;
@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_ARB_bindless_texture : enable
 out vec4 FragColor;
 
 in VS_OUT {
@@ -7,6 +8,7 @@ in VS_OUT {
   vec3 TangentLightDir;
   vec3 TangentViewPos;
   vec3 TangentFragPos;
+  flat ivec4 Layers;
 } fs_in;
 
 struct DirLight {
@@ -23,21 +25,50 @@ uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
 uniform sampler2D texture_normal1;
 uniform sampler2D texture_height1;
+// the same slots packed into texture arrays, see TextureArrays; fs_in.Layers picks the layer
+uniform sampler2DArray texture_diffuse_array;
+uniform sampler2DArray texture_specular_array;
+uniform sampler2DArray texture_normal_array;
+uniform sampler2DArray texture_height_array;
 
 vec2 ParallaxMapping(vec2 TexCoords, vec3 viewDir);
 
+#ifdef GL_ARB_bindless_texture
+// per slot, xy = handle of texture_<type>1 and zw = handle of texture_<type>_array, see MaterialHandles;
+// a zero handle means the texture is bound to its unit instead
+layout (std140) uniform MaterialTextureBlock {
+  uvec4 textures[4];
+} handles;
+
+vec4 sampleSlot(int slot, sampler2D single, sampler2DArray array, int layer, vec2 uv)
+{
+  uvec4 handle = handles.textures[slot];
+  if (layer >= 0)
+    return handle.zw != uvec2(0) ? texture(sampler2DArray(handle.zw), vec3(uv, float(layer))) : texture(array, vec3(uv, float(layer)));
+  return handle.xy != uvec2(0) ? texture(sampler2D(handle.xy), uv) : texture(single, uv);
+}
+#else
+vec4 sampleSlot(int slot, sampler2D single, sampler2DArray array, int layer, vec2 uv)
+{
+  return layer >= 0 ? texture(array, vec3(uv, float(layer))) : texture(single, uv);
+}
+#endif
+
 void main()
 {
   // Obtain normal from normal texture in range [0, 1], transfrom to [-1, 1]
-  vec3 normal = texture(texture_normal1, fs_in.TexCoords).rgb;
-  normal = normalize(normal * 2.0 - 1.0);
+  // Z is rebuilt from X and Y, so BC5 normal maps (red and green only) work as well
+  vec3 normal;
+  normal.xy = sampleSlot(2, texture_normal1, texture_normal_array, fs_in.Layers.z, fs_in.TexCoords).rg * 2.0 - 1.0;
+  normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+  normal = normalize(normal);
   // Direct light
   vec3 lightDir = normalize(fs_in.TangentLightDir);
   vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
   vec2 texCoords = ParallaxMapping(fs_in.TexCoords, viewDir);
 
   // Read diffuse color
-  vec3 color = texture(texture_diffuse1, texCoords).rgb;
+  vec3 color = sampleSlot(0, texture_diffuse1, texture_diffuse_array, fs_in.Layers.x, texCoords).rgb;
 
   // Ambient
   vec3 ambient = dirLight.ambient * color;
@@ -51,14 +82,14 @@ void main()
   float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
   // vec3 halfwayDir = normalize(lightDir + viewDir);  
   // float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
-  vec3 specular = dirLight.specular * spec * texture(texture_specular1, texCoords).rgb;
+  vec3 specular = dirLight.specular * spec * sampleSlot(1, texture_specular1, texture_specular_array, fs_in.Layers.y, texCoords).rgb;
   
   FragColor = vec4((ambient + diffuse + specular), 1.0);
 }
 
 vec2 ParallaxMapping(vec2 TexCoords, vec3 viewDir)
 {
-  float height = texture(texture_height1, TexCoords).r;
+  float height = sampleSlot(3, texture_height1, texture_height_array, fs_in.Layers.w, TexCoords).r;
   vec2 p = viewDir.xy / viewDir.z * (height * height_scale);
   return TexCoords - p;
 }
\ No newline at end of file
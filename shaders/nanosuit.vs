@@ -1,5 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
@@ -11,29 +11,38 @@ out VS_OUT {
   vec3 TangentLightDir;
   vec3 TangentViewPos;
   vec3 TangentFragPos;
+  flat ivec4 Layers;
 } vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 uniform vec3 lightDir;
-uniform vec3 viewPos;
+
+#include "camera.glsl"
+#include "material.glsl"
+#include "packed_vertex.glsl"
 
 void main()
 {
-  vec3 fragPos = vec3(model * vec4(aPos, 1.0));
-  gl_Position = projection * view * vec4(fragPos, 1.0);
+  vec3 position = aPos.xyz * material.positionScale.xyz + material.positionOffset.xyz;
+  bool packedVertex = material.positionScale.w != 0.0;
+  vec3 normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
+  vec3 tangent = packedVertex ? octDecode(aTangent.xy) : aTangent;
+  vec3 bitangent = packedVertex ? cross(normal, tangent) * (aPos.w * 2.0 - 1.0) : aBitangent;
+
+  vec3 fragPos = vec3(model * vec4(position, 1.0));
+  gl_Position = camera.viewProjection * vec4(fragPos, 1.0);
   vs_out.FragPos = fragPos;
   vs_out.TexCoords = aTexCoords;
+  vs_out.Layers = material.layers;
 
   mat3 normalMatrix = transpose(inverse(mat3(model)));
-  vec3 T = normalize(normalMatrix * aTangent);
-  vec3 B = normalize(normalMatrix * aBitangent);
-  vec3 N = normalize(normalMatrix * aNormal);
+  vec3 T = normalize(normalMatrix * tangent);
+  vec3 B = normalize(normalMatrix * bitangent);
+  vec3 N = normalize(normalMatrix * normal);
   mat3 TBN = transpose(mat3(T, B, N));
 
   vs_out.TangentFragPos = TBN * fragPos;
-  vs_out.TangentViewPos = TBN * viewPos;
+  vs_out.TangentViewPos = TBN * camera.position.xyz;
   vs_out.TangentLightDir = TBN * lightDir;
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#version 430 core
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+layout (location = 7) in uint aDrawID; // baseInstance of the indirect command, see DRAW_ID_ATTRIBUTE
+
+out VS_OUT {
+  vec3 FragPos;
+  vec2 TexCoords;
+  vec3 TangentLightDir;
+  vec3 TangentViewPos;
+  vec3 TangentFragPos;
+  flat ivec4 Layers;
+} vs_out;
+
+uniform vec3 lightDir;
+
+#include "camera.glsl"
+
+// per-draw transform and mesh constants, see DrawData; positionScale.w is 1 for the packed vertex layout
+struct DrawData {
+  mat4 model;
+  vec4 diffuseColor;
+  vec4 specularColor;
+  vec4 positionScale;
+  vec4 positionOffset;
+  ivec4 layers;
+};
+
+layout (std430, binding = 0) readonly buffer DrawBlock {
+  DrawData draws[];
+};
+
+#include "packed_vertex.glsl"
+
+void main()
+{
+  DrawData material = draws[aDrawID];
+  mat4 model = material.model;
+  vec3 position = aPos.xyz * material.positionScale.xyz + material.positionOffset.xyz;
+  bool packedVertex = material.positionScale.w != 0.0;
+  vec3 normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
+  vec3 tangent = packedVertex ? octDecode(aTangent.xy) : aTangent;
+  vec3 bitangent = packedVertex ? cross(normal, tangent) * (aPos.w * 2.0 - 1.0) : aBitangent;
+
+  vec3 fragPos = vec3(model * vec4(position, 1.0));
+  gl_Position = camera.viewProjection * vec4(fragPos, 1.0);
+  vs_out.FragPos = fragPos;
+  vs_out.TexCoords = aTexCoords;
+  vs_out.Layers = material.layers;
+
+  mat3 normalMatrix = transpose(inverse(mat3(model)));
+  vec3 T = normalize(normalMatrix * tangent);
+  vec3 B = normalize(normalMatrix * bitangent);
+  vec3 N = normalize(normalMatrix * normal);
+  mat3 TBN = transpose(mat3(T, B, N));
+
+  vs_out.TangentFragPos = TBN * fragPos;
+  vs_out.TangentViewPos = TBN * camera.position.xyz;
+  vs_out.TangentLightDir = TBN * lightDir;
+}
\ No newline at end of file
@@ -1,9 +1,15 @@
 #version 330 core
+#extension GL_ARB_bindless_texture : enable
 out vec4 FragColor;
 
 in vec3 TexCoords;
 
+// set to the cubemap's handle when bindless textures are available, see BindlessTextures
+#ifdef GL_ARB_bindless_texture
+layout (bindless_sampler) uniform samplerCube skybox;
+#else
 uniform samplerCube skybox;
+#endif
 
 void main()
 {
@@ -3,12 +3,12 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "camera.glsl"
 
 void main()
 {
   TexCoords = vec3(aPos.x, -aPos.y, aPos.z);
-  vec4 position = projection * view * vec4(aPos, 1.0);
+  // drop the translation so the skybox stays centred on the camera
+  vec4 position = camera.projection * mat4(mat3(camera.view)) * vec4(aPos, 1.0);
   gl_Position = position.xyww;
 }
\ No newline at end of file